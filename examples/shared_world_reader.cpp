@@ -0,0 +1,58 @@
+﻿// Minimal consumer of `gol --shm <name>`: follows the live world from another
+// process and prints the population of the latest generation twice a second.
+//
+//   gol_shm_reader <name>
+
+#include "../src/shared_world.h"
+
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+int main(const int argc, char** argv) {
+    if (argc != 2) {
+        cerr << "Usage: gol_shm_reader <name>\n";
+        return 1;
+    }
+
+    SharedWorldReader reader;
+    if (!reader.open(argv[1])) {
+        cerr << format("No world published as '{}'\n", argv[1]);
+        return 1;
+    }
+
+    const SharedWorldHeader& header = *reader.header;
+    cout << format("{}x{} world\n", header.width, header.height);
+
+    int64_t lastGeneration = -1;
+    while (reader.engineRunning()) {
+        SharedWorldFrame frame;
+
+        // Read in place, then throw the result away if the engine reused the slot meanwhile
+        if (reader.acquireLatest(frame) && frame.generation != lastGeneration) {
+            int64_t population = 0;
+            for (uint32_t row = 0; row < header.height; row++) {
+                const uint8_t* cells = frame.cells + static_cast<size_t>(row) * header.rowStride;
+                for (uint32_t column = 0; column < header.width; column++) {
+                    population += cells[column];
+                }
+            }
+
+            if (reader.isValid(frame)) {
+                cout << format("generation {} population {}\n", frame.generation, population);
+                lastGeneration = frame.generation;
+                this_thread::sleep_for(chrono::milliseconds(500));
+                continue;
+            }
+        }
+
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    cout << "Engine stopped\n";
+    return 0;
+}
@@ -0,0 +1,132 @@
+﻿#pragma once
+
+#include <cstdint>
+
+// Conway's Life on bit-packed rows (see bitpack.h), 64 cells per operation.
+//
+// For every cell the eight neighbour bits are summed with bitwise full adders
+// into a binary count (ones, twos, fours, eights); the rule then only needs
+// count == 3, or count == 2 for live cells.
+
+struct SumBits {
+    uint64_t sum;
+    uint64_t carry;
+};
+
+inline SumBits addBits(const uint64_t a, const uint64_t b, const uint64_t c) {
+    const uint64_t partial = a ^ b;
+    return {partial ^ c, (a & b) | (c & partial)};
+}
+
+// Steps one row of `wordCount` words whose row wraps around horizontally; the
+// row width must be exactly wordCount * 64 cells.
+inline void lifeRowStep(const uint64_t* above, const uint64_t* row, const uint64_t* below,
+                        uint64_t* next, const int wordCount) {
+    for (int i = 0; i < wordCount; i++) {
+        const int west = i == 0 ? wordCount - 1 : i - 1;
+        const int east = i == wordCount - 1 ? 0 : i + 1;
+
+        // Cell j's west neighbour is cell j - 1, one bit lower
+        const auto westOf = [&](const uint64_t* r) { return (r[i] << 1) | (r[west] >> 63); };
+        const auto eastOf = [&](const uint64_t* r) { return (r[i] >> 1) | (r[east] << 63); };
+
+        const SumBits top = addBits(westOf(above), above[i], eastOf(above));
+        const SumBits bottom = addBits(westOf(below), below[i], eastOf(below));
+        const uint64_t middleWest = westOf(row);
+        const uint64_t middleEast = eastOf(row);
+        const SumBits middle = {middleWest ^ middleEast, middleWest & middleEast};
+
+        const SumBits ones = addBits(top.sum, bottom.sum, middle.sum);
+        const SumBits twos = addBits(ones.carry, top.carry, bottom.carry);
+        const uint64_t twosBit = twos.sum ^ middle.carry;
+        const uint64_t foursCarry = twos.sum & middle.carry;
+        const uint64_t foursOrMore = twos.carry | foursCarry;
+
+        next[i] = twosBit & ~foursOrMore & (ones.sum | row[i]);
+    }
+}
+
+// Rows of any width: bits past the last cell are zero and stay zero, and the
+// neighbours beyond the first and last cell come from the halo (topology.h).
+inline uint64_t lastWordMask(const int cellCount) {
+    const int lastBits = cellCount % 64;
+    return lastBits == 0 ? ~0ull : (1ull << lastBits) - 1;
+}
+
+// A packed row with the cells just beyond its first and last cell
+struct EdgedRow {
+    const uint64_t* cells;
+    bool west;
+    bool east;
+};
+
+inline uint64_t westOf(const EdgedRow& r, const int i) {
+    const uint64_t carry = i == 0 ? r.west : r.cells[i - 1] >> 63;
+    return (r.cells[i] << 1) | carry;
+}
+
+inline uint64_t eastOf(const EdgedRow& r, const int i, const int wordCount, const int cellCount) {
+    uint64_t east = r.cells[i] >> 1;
+    if (i + 1 < wordCount) east |= r.cells[i + 1] << 63;
+    if (i == wordCount - 1) east |= static_cast<uint64_t>(r.east) << ((cellCount - 1) % 64);
+    return east;
+}
+
+// Live neighbour count of 64 cells as a 4-bit binary number, 0 to 8
+struct NeighbourCount {
+    uint64_t ones;
+    uint64_t twos;
+    uint64_t fours;
+    uint64_t eights;
+};
+
+inline NeighbourCount countNeighbours(const EdgedRow& above, const EdgedRow& row, const EdgedRow& below,
+                                      const int i, const int wordCount, const int cellCount) {
+    const SumBits top = addBits(westOf(above, i), above.cells[i], eastOf(above, i, wordCount, cellCount));
+    const SumBits bottom = addBits(westOf(below, i), below.cells[i], eastOf(below, i, wordCount, cellCount));
+    const uint64_t middleWest = westOf(row, i);
+    const uint64_t middleEast = eastOf(row, i, wordCount, cellCount);
+    const SumBits middle = {middleWest ^ middleEast, middleWest & middleEast};
+
+    const SumBits ones = addBits(top.sum, bottom.sum, middle.sum);
+    const SumBits twos = addBits(ones.carry, top.carry, bottom.carry);
+    const uint64_t foursCarry = twos.sum & middle.carry;
+
+    return {ones.sum, twos.sum ^ middle.carry, twos.carry ^ foursCarry, twos.carry & foursCarry};
+}
+
+// The same for the von Neumann neighbourhood, N, E, S and W: three of them go
+// through one full adder, the fourth is added to its binary sum.
+inline NeighbourCount countVonNeumannNeighbours(const EdgedRow& above, const EdgedRow& row, const EdgedRow& below,
+                                                const int i, const int wordCount, const int cellCount) {
+    const SumBits three = addBits(above.cells[i], below.cells[i], westOf(row, i));
+    const uint64_t east = eastOf(row, i, wordCount, cellCount);
+    const uint64_t onesCarry = three.sum & east;
+
+    return {three.sum ^ east, three.carry ^ onesCarry, three.carry & onesCarry, 0};
+}
+
+// And for the hexagonal one, Moore without the NE and SW cells (see
+// NeighbourhoodShape): two full adders over three cells each, then one more
+// for their carries.
+inline NeighbourCount countHexNeighbours(const EdgedRow& above, const EdgedRow& row, const EdgedRow& below,
+                                         const int i, const int wordCount, const int cellCount) {
+    const SumBits north = addBits(westOf(above, i), above.cells[i], westOf(row, i));
+    const SumBits south = addBits(eastOf(row, i, wordCount, cellCount), below.cells[i], eastOf(below, i, wordCount, cellCount));
+    const uint64_t onesCarry = north.sum & south.sum;
+    const SumBits twos = addBits(north.carry, south.carry, onesCarry);
+
+    return {north.sum ^ south.sum, twos.sum, twos.carry, 0};
+}
+
+// Cells whose count is in `mask` (bit n for count n, see LifeRule). With a
+// constant mask the loop unrolls to the few terms the rule needs.
+inline uint64_t countInMask(const NeighbourCount& count, const uint16_t mask) {
+    uint64_t cells = 0;
+    for (int n = 0; n <= 8; n++) {
+        if (!(mask >> n & 1)) continue;
+        cells |= (n & 1 ? count.ones : ~count.ones) & (n & 2 ? count.twos : ~count.twos)
+            & (n & 4 ? count.fours : ~count.fours) & (n & 8 ? count.eights : ~count.eights);
+    }
+    return cells;
+}
@@ -0,0 +1,47 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Bit-packed rows: cell i of a row lives in bit i % 64 of word i / 64, so on
+// little-endian hosts the bytes read LSB-first, cell 0 in bit 0 of byte 0.
+
+constexpr int packedWordCount(const int cellCount) {
+    return (cellCount + 63) / 64;
+}
+
+// Packs one-byte cells (0 or 1) eight at a time: the multiply gathers the low
+// bit of every byte into the top byte of the product.
+inline void packCells(const bool* cells, const int cellCount, uint64_t* words) {
+    constexpr uint64_t GATHER = 0x0102040810204080ull;
+
+    memset(words, 0, sizeof(uint64_t) * packedWordCount(cellCount));
+
+    int i = 0;
+    for (; i + 8 <= cellCount; i += 8) {
+        uint64_t eightCells;
+        memcpy(&eightCells, cells + i, sizeof(eightCells));
+        words[i / 64] |= ((eightCells * GATHER) >> 56) << (i % 64);
+    }
+    for (; i < cellCount; i++) {
+        words[i / 64] |= static_cast<uint64_t>(cells[i]) << (i % 64);
+    }
+}
+
+// Inverse of packCells: spreads a byte to all eight lanes, isolates bit i in
+// lane i and turns every non-zero lane into 1.
+inline void unpackCells(const uint64_t* words, const int cellCount, bool* cells) {
+    constexpr uint64_t SPREAD = 0x0101010101010101ull;
+    constexpr uint64_t LANE_BITS = 0x8040201008040201ull;
+    constexpr uint64_t HIGH_BITS = 0x7F7F7F7F7F7F7F7Full;
+
+    int i = 0;
+    for (; i + 8 <= cellCount; i += 8) {
+        const uint64_t eightBits = (words[i / 64] >> (i % 64)) & 0xFF;
+        const uint64_t eightCells = ((((eightBits * SPREAD) & LANE_BITS) + HIGH_BITS) >> 7) & SPREAD;
+        memcpy(cells + i, &eightCells, sizeof(eightCells));
+    }
+    for (; i < cellCount; i++) {
+        cells[i] = (words[i / 64] >> (i % 64)) & 1;
+    }
+}
@@ -0,0 +1,199 @@
+﻿#include "checkpoint.h"
+#include "bitpack.h"
+#include "mapped_file.h"
+#include "sim.h"
+#include "snapshot.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static_assert(sizeof(CheckpointHeader) <= CHECKPOINT_PAGE_SIZE);
+
+uint32_t checkpointRowStride() {
+    return packedWordCount(N) * sizeof(uint64_t);
+}
+
+uint64_t fnv1a64(const uint8_t* data, const size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+uint64_t pageAlign(const uint64_t size) {
+    return (size + CHECKPOINT_PAGE_SIZE - 1) / CHECKPOINT_PAGE_SIZE * CHECKPOINT_PAGE_SIZE;
+}
+
+bool writeCheckpoint(const string& path, const World& world, const string& rule) {
+    const uint32_t rowStride = checkpointRowStride();
+    const uint64_t dataSize = static_cast<uint64_t>(rowStride) * N;
+
+    // Every engine keeping planes packs their rows like the cells
+    const bool planesSaved = !world.Planes.empty() && world.PlaneRowWords * sizeof(uint64_t) == rowStride;
+    const uint32_t planeCount = planesSaved ? static_cast<uint32_t>(world.PlaneCount) : 0;
+    const uint64_t planesSize = dataSize * planeCount;
+    const uint64_t statesSize = world.States.size() == static_cast<size_t>(N) * N ? world.States.size() : 0;
+    const uint64_t payloadSize = dataSize + planesSize + statesSize;
+
+    vector<uint8_t> file(CHECKPOINT_PAGE_SIZE + pageAlign(payloadSize), 0);
+    uint8_t* payload = file.data() + CHECKPOINT_PAGE_SIZE;
+
+    for (int x = 0; x < N; x++) {
+        uint8_t* row = payload + static_cast<size_t>(x) * rowStride;
+        packCells(world.Data[x], N, reinterpret_cast<uint64_t*>(row));
+    }
+    if (planesSaved) {
+        memcpy(payload + dataSize, world.Planes.data(), planesSize);
+    }
+    if (statesSize > 0) {
+        memcpy(payload + dataSize + planesSize, world.States.data(), statesSize);
+    }
+
+    CheckpointHeader header {};
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.headerSize = sizeof(CheckpointHeader);
+    header.width = N;
+    header.height = N;
+    header.rowStride = rowStride;
+    header.planeCount = planeCount;
+    header.generation = static_cast<uint64_t>(world.Generation);
+    header.payloadOffset = CHECKPOINT_PAGE_SIZE;
+    header.payloadSize = payloadSize;
+    header.statesSize = statesSize;
+    header.payloadChecksum = fnv1a64(payload, payloadSize);
+    rule.copy(header.rule, sizeof(header.rule) - 1);
+    memcpy(file.data(), &header, sizeof(header));
+
+    // Write next to the target and rename, so a crash never leaves a torn checkpoint
+    const string temporaryPath = path + ".tmp";
+    FILE* output = fopen(temporaryPath.c_str(), "wb");
+    if (output == nullptr) {
+        cerr << format("Cannot create checkpoint '{}'\n", temporaryPath);
+        return false;
+    }
+
+    const bool written = fwrite(file.data(), 1, file.size(), output) == file.size();
+    const bool closed = fclose(output) == 0;
+
+    error_code error;
+    if (written && closed) {
+        filesystem::rename(temporaryPath, path, error);
+    }
+    if (!written || !closed || error) {
+        cerr << format("Failed to write checkpoint '{}'\n", path);
+        filesystem::remove(temporaryPath, error);
+        return false;
+    }
+
+    return true;
+}
+
+bool restoreCheckpoint(const string& path, World& world, string& rule) {
+    MappedFile file;
+    if (!file.map(path)) {
+        cerr << format("Cannot map checkpoint '{}'\n", path);
+        return false;
+    }
+
+    CheckpointHeader header;
+    if (file.size < sizeof(header)) {
+        cerr << format("Checkpoint '{}' is truncated\n", path);
+        return false;
+    }
+    memcpy(&header, file.data, sizeof(header));
+
+    if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 || header.version != CHECKPOINT_VERSION) {
+        cerr << format("'{}' is not a version {} checkpoint\n", path, CHECKPOINT_VERSION);
+        return false;
+    }
+    if (header.width != static_cast<uint32_t>(N) || header.height != static_cast<uint32_t>(N) || header.rowStride != checkpointRowStride()) {
+        cerr << format("Checkpoint '{}' is {}x{}, the world is {}x{} (see --size)\n", path, header.width, header.height, N, N);
+        return false;
+    }
+    const uint64_t dataSize = static_cast<uint64_t>(header.rowStride) * header.height;
+    const uint64_t planesSize = dataSize * header.planeCount;
+    if ((header.statesSize != 0 && header.statesSize != static_cast<uint64_t>(N) * N)
+        || header.payloadSize != dataSize + planesSize + header.statesSize
+        || header.payloadOffset % sizeof(uint64_t) != 0
+        || header.payloadOffset > file.size || file.size - header.payloadOffset < header.payloadSize) {
+        cerr << format("Checkpoint '{}' is truncated\n", path);
+        return false;
+    }
+
+    const uint8_t* payload = file.data + header.payloadOffset;
+    if (fnv1a64(payload, header.payloadSize) != header.payloadChecksum) {
+        cerr << format("Checkpoint '{}' failed its checksum\n", path);
+        return false;
+    }
+
+    for (int x = 0; x < N; x++) {
+        const uint8_t* row = payload + static_cast<size_t>(x) * header.rowStride;
+        unpackCells(reinterpret_cast<const uint64_t*>(row), N, world.Data[x]);
+    }
+
+    world.PlaneCount = static_cast<int>(header.planeCount);
+    world.PlaneRowWords = static_cast<int>(header.rowStride / sizeof(uint64_t));
+    world.Planes.resize(planesSize / sizeof(uint64_t));
+    memcpy(world.Planes.data(), payload + dataSize, planesSize);
+
+    world.States.resize(header.statesSize);
+    memcpy(world.States.data(), payload + dataSize + planesSize, header.statesSize);
+
+    world.Generation = static_cast<int>(header.generation);
+    rule.assign(header.rule, strnlen(header.rule, sizeof(header.rule)));
+
+    return true;
+}
+
+
+mutex checkpointMutex;
+condition_variable checkpointWake;
+bool checkpointStopping = false;
+thread checkpointThread;
+
+void startCheckpointing(const string& path, const float intervalSeconds) {
+    if (path.empty()) return;
+
+    const chrono::duration<float> interval {max(1.0f, intervalSeconds)};
+    checkpointStopping = false;
+
+    checkpointThread = thread{[path, interval] {
+        const auto snapshot = make_unique<World>();
+        bool stopping = false;
+
+        while (!stopping) {
+            {
+                unique_lock lock(checkpointMutex);
+                stopping = checkpointWake.wait_for(lock, interval, [] { return checkpointStopping; });
+            }
+
+            takeWorldSnapshot(*snapshot);
+            if (writeCheckpoint(path, *snapshot, formatRule(simRule()))) {
+                cerr << format("Checkpointed generation {} to '{}'\n", snapshot->Generation, path);
+            }
+        }
+    }};
+}
+
+void stopCheckpointing() {
+    if (!checkpointThread.joinable()) return;
+
+    {
+        lock_guard lock(checkpointMutex);
+        checkpointStopping = true;
+    }
+    checkpointWake.notify_all();
+    checkpointThread.join();
+}
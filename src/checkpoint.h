@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include "world.h"
+
+#include <cstdint>
+#include <string>
+
+// Checkpoint file layout, little-endian:
+//   CheckpointHeader, zero padded to CHECKPOINT_PAGE_SIZE
+//   payload: N rows of bit-packed cells (bit y % 8 of byte y / 8),
+//            each row padded to a multiple of 8 bytes, then the planeCount
+//            bit planes of World::Planes in the same row layout, then the
+//            bytes of World::States if any, the payload itself zero padded
+//            to a multiple of CHECKPOINT_PAGE_SIZE
+constexpr uint32_t CHECKPOINT_VERSION = 3;
+constexpr uint32_t CHECKPOINT_PAGE_SIZE = 4096;
+constexpr char CHECKPOINT_MAGIC[8] = {'G', 'O', 'L', 'C', 'K', 'P', 'T', '\0'};
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowStride;         // bytes per packed row
+    uint32_t planeCount;        // engine state such as Generations' dying states, 0 if none
+    uint64_t generation;
+    uint64_t payloadOffset;
+    uint64_t payloadSize;       // rowStride * height * (1 + planeCount) + statesSize, without page padding
+    uint64_t payloadChecksum;   // FNV-1a 64 of the unpadded payload
+    char rule[64];
+    uint64_t statesSize;        // states of multi-state rule tables, width * height or 0
+};
+
+bool writeCheckpoint(const std::string& path, const World& world, const std::string& rule);
+
+// Maps the checkpoint and unpacks it straight from the mapping into `world`,
+// its planes and states included; the engine of the checkpoint's rule picks
+// them up.
+bool restoreCheckpoint(const std::string& path, World& world, std::string& rule);
+
+// Writes a checkpoint of a world snapshot every intervalSeconds on a
+// background thread, plus a final one in stopCheckpointing.
+void startCheckpointing(const std::string& path, float intervalSeconds);
+void stopCheckpointing();
@@ -0,0 +1,413 @@
+﻿#include "dataset.h"
+#include "bitlife.h"
+#include "output_file.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Bytes of samples handed to the writer at a time
+constexpr size_t DATASET_BUFFER_BYTES = 8u << 20;
+
+struct DatasetLayout {
+    int worldSize = 0;
+    int worldWords = 0;          // words per world row
+    int tileSize = 0;
+    int rowWords = 0;            // words per frame row
+    size_t frameBytes = 0;
+    size_t sampleBytes = 0;
+    int64_t samplesPerBuffer = 0;
+    int64_t samplesPerShard = 0;
+    int64_t chunksPerShard = 0;
+    int64_t shardCount = 0;
+
+    int64_t shardSamples(const int64_t shard, const int64_t samples) const {
+        return min(samplesPerShard, samples - shard * samplesPerShard);
+    }
+    int64_t shardChunks(const int64_t shard, const int64_t samples) const {
+        return (shardSamples(shard, samples) + samplesPerBuffer - 1) / samplesPerBuffer;
+    }
+    uint64_t indexOffset(const int64_t shardSampleCount) const {
+        return alignToDirectIo(DATASET_HEADER_SIZE + shardSampleCount * sampleBytes);
+    }
+};
+
+struct TilePosition {
+    uint32_t top;
+    uint32_t left;
+};
+
+// Random per sample, frames of whole worlds are not shifted
+TilePosition tilePosition(const uint64_t key, const DatasetLayout& layout) {
+    if (layout.tileSize == layout.worldSize) return {0, 0};
+
+    const uint64_t hash = mixBits(key ^ 0xD1B54A32D192ED03ull);
+    const uint32_t size = static_cast<uint32_t>(layout.worldSize);
+    return {static_cast<uint32_t>(hash) % size, static_cast<uint32_t>(hash >> 32) % size};
+}
+
+// A run of consecutive samples of one shard, stored in one write
+struct DatasetChunk {
+    int64_t shard = 0;
+    int64_t firstSample = 0;   // in the dataset
+    int64_t sampleCount = 0;
+    uint64_t offset = 0;       // in the shard file
+    uint8_t* buffer = nullptr;
+};
+
+struct DatasetState {
+    DatasetSettings settings;
+    DatasetLayout layout;
+
+    atomic<int64_t> nextChunk {0};
+    atomic<bool> failed {false};
+
+    mutex buffersMutex;
+    condition_variable buffersChanged;
+    vector<uint8_t*> freeBuffers;
+    deque<DatasetChunk> filledChunks;
+    int producersLeft = 0;
+    double stallSeconds = 0;
+    bool directIoRefused = false;
+
+    uint8_t* acquireBuffer() {
+        unique_lock lock {buffersMutex};
+        if (freeBuffers.empty()) {
+            const chrono::steady_clock::time_point stallStart = chrono::steady_clock::now();
+            buffersChanged.wait(lock, [this] { return !freeBuffers.empty() || failed; });
+            stallSeconds += chrono::duration<double>(chrono::steady_clock::now() - stallStart).count();
+            if (failed) return nullptr;
+        }
+
+        uint8_t* buffer = freeBuffers.back();
+        freeBuffers.pop_back();
+        return buffer;
+    }
+
+    void submit(const DatasetChunk& chunk) {
+        {
+            lock_guard lock {buffersMutex};
+            filledChunks.push_back(chunk);
+        }
+        buffersChanged.notify_all();
+    }
+
+    void producerDone() {
+        {
+            lock_guard lock {buffersMutex};
+            --producersLeft;
+        }
+        buffersChanged.notify_all();
+    }
+
+    void fail() {
+        {
+            lock_guard lock {buffersMutex};
+            failed = true;
+        }
+        buffersChanged.notify_all();
+    }
+};
+
+// Frame rows cropped from the world, starting at column `left` and wrapping
+// around; bits past the tile width stay zero.
+void cropFrame(const uint64_t* world, const DatasetLayout& layout, const TilePosition tile, uint64_t* frame) {
+    const int lastBits = layout.tileSize % 64;
+    const uint64_t lastMask = lastBits == 0 ? ~0ull : (1ull << lastBits) - 1;
+
+    for (int row = 0; row < layout.tileSize; row++) {
+        const uint64_t* source = world + static_cast<size_t>((tile.top + row) % layout.worldSize) * layout.worldWords;
+
+        for (int i = 0; i < layout.rowWords; i++) {
+            const int start = static_cast<int>((tile.left + 64ull * i) % layout.worldSize);
+            const int word = start / 64;
+            const int shift = start % 64;
+
+            uint64_t bits = source[word] >> shift;
+            if (shift != 0) {
+                bits |= source[(word + 1) % layout.worldWords] << (64 - shift);
+            }
+            *frame++ = i == layout.rowWords - 1 ? bits & lastMask : bits;
+        }
+    }
+}
+
+struct SampleWorlds {
+    vector<uint64_t> now;
+    vector<uint64_t> next;
+
+    void step(const DatasetLayout& layout) {
+        const int words = layout.worldWords;
+        const int size = layout.worldSize;
+
+        for (int row = 0; row < size; row++) {
+            lifeRowStep(&now[static_cast<size_t>((row + size - 1) % size) * words], &now[static_cast<size_t>(row) * words],
+                &now[static_cast<size_t>((row + 1) % size) * words], &next[static_cast<size_t>(row) * words], words);
+        }
+        swap(now, next);
+    }
+};
+
+void produceSample(const DatasetSettings& settings, const DatasetLayout& layout, const int64_t sample,
+                   SampleWorlds& worlds, uint8_t* destination) {
+    // The same world as a normal run with --size worldSize --seed <seed + sample>
+    const uint64_t key = seedKey(settings.seed.seed + static_cast<uint64_t>(sample));
+    const uint64_t threshold = seedThreshold(settings.seed.density);
+
+    for (int row = 0; row < layout.worldSize; row++) {
+        uint64_t* words = &worlds.now[static_cast<size_t>(row) * layout.worldWords];
+        for (int i = 0; i < layout.worldWords; i++) {
+            words[i] = seedWord(key, threshold, static_cast<uint64_t>(i) * 64, row);
+        }
+    }
+
+    for (int generation = 0; generation < settings.warmup; generation++) {
+        worlds.step(layout);
+    }
+
+    const TilePosition tile = tilePosition(key, layout);
+    for (int frame = 0; frame < settings.framesPerSample; frame++) {
+        if (frame > 0) {
+            for (int generation = 0; generation < settings.frameStride; generation++) {
+                worlds.step(layout);
+            }
+        }
+        cropFrame(worlds.now.data(), layout, tile, reinterpret_cast<uint64_t*>(destination + frame * layout.frameBytes));
+    }
+}
+
+void produceChunks(DatasetState& state) {
+    const DatasetLayout& layout = state.layout;
+    const int64_t samples = state.settings.samples;
+
+    SampleWorlds worlds;
+    worlds.now.resize(static_cast<size_t>(layout.worldSize) * layout.worldWords);
+    worlds.next.resize(worlds.now.size());
+
+    const int64_t chunkCount = layout.shardCount * layout.chunksPerShard;
+    for (int64_t chunkNumber; !state.failed && (chunkNumber = state.nextChunk++) < chunkCount;) {
+        DatasetChunk chunk;
+        chunk.shard = chunkNumber / layout.chunksPerShard;
+
+        const int64_t firstInShard = chunkNumber % layout.chunksPerShard * layout.samplesPerBuffer;
+        chunk.sampleCount = min(layout.samplesPerBuffer, layout.shardSamples(chunk.shard, samples) - firstInShard);
+        if (chunk.sampleCount <= 0) continue;  // past the end of a short last shard
+
+        chunk.firstSample = chunk.shard * layout.samplesPerShard + firstInShard;
+        chunk.offset = DATASET_HEADER_SIZE + firstInShard * layout.sampleBytes;
+        chunk.buffer = state.acquireBuffer();
+        if (chunk.buffer == nullptr) break;
+
+        for (int64_t i = 0; i < chunk.sampleCount; i++) {
+            produceSample(state.settings, layout, chunk.firstSample + i, worlds, chunk.buffer + i * layout.sampleBytes);
+        }
+
+        // A short chunk is padded to the alignment, clear what the buffer held before
+        const size_t used = chunk.sampleCount * layout.sampleBytes;
+        memset(chunk.buffer + used, 0, alignToDirectIo(used) - used);
+
+        state.submit(chunk);
+    }
+
+    state.producerDone();
+}
+
+struct OpenShard {
+    OutputFile file;
+    int64_t chunksLeft = 0;
+};
+
+bool finishShard(const DatasetState& state, const int64_t shard, OutputFile& file) {
+    const DatasetSettings& settings = state.settings;
+    const DatasetLayout& layout = state.layout;
+    const int64_t sampleCount = layout.shardSamples(shard, settings.samples);
+    const int64_t firstSample = shard * layout.samplesPerShard;
+
+    const uint64_t indexOffset = layout.indexOffset(sampleCount);
+    const size_t indexBytes = sampleCount * sizeof(DatasetIndexEntry);
+    uint8_t* index = allocateAligned(alignToDirectIo(indexBytes));
+
+    for (int64_t i = 0; i < sampleCount; i++) {
+        const TilePosition tile = tilePosition(seedKey(settings.seed.seed + static_cast<uint64_t>(firstSample + i)), layout);
+        const DatasetIndexEntry entry {
+            static_cast<uint64_t>(firstSample + i),
+            DATASET_HEADER_SIZE + i * layout.sampleBytes,
+            tile.top,
+            tile.left,
+        };
+        memcpy(index + i * sizeof(entry), &entry, sizeof(entry));
+    }
+
+    bool written = file.writeAt(index, alignToDirectIo(indexBytes), indexOffset);
+    freeAligned(index);
+
+    // The header goes last, a shard with a valid header is complete
+    uint8_t* headerBlock = allocateAligned(DATASET_HEADER_SIZE);
+    DatasetShardHeader header {};
+    memcpy(header.magic, DATASET_MAGIC, sizeof(header.magic));
+    header.version = DATASET_VERSION;
+    header.headerSize = DATASET_HEADER_SIZE;
+    header.worldSize = static_cast<uint32_t>(layout.worldSize);
+    header.tileSize = static_cast<uint32_t>(layout.tileSize);
+    header.rowWords = static_cast<uint32_t>(layout.rowWords);
+    header.framesPerSample = static_cast<uint32_t>(settings.framesPerSample);
+    header.frameStride = static_cast<uint32_t>(settings.frameStride);
+    header.warmup = static_cast<uint32_t>(settings.warmup);
+    header.seed = settings.seed.seed;
+    header.density = settings.seed.density;
+    header.sampleCount = static_cast<uint32_t>(sampleCount);
+    header.sampleBytes = layout.sampleBytes;
+    header.firstSample = static_cast<uint64_t>(firstSample);
+    header.indexOffset = indexOffset;
+    memcpy(headerBlock, &header, sizeof(header));
+
+    written = written && file.writeAt(headerBlock, DATASET_HEADER_SIZE, 0);
+    freeAligned(headerBlock);
+
+    written = written && file.truncate(indexOffset + indexBytes);
+    file.close();
+    return written;
+}
+
+// Stores filled chunks in the order they arrive, opening each shard with its
+// first chunk and completing it with its last.
+void writeChunks(DatasetState& state) {
+    map<int64_t, OpenShard> openShards;
+
+    while (true) {
+        DatasetChunk chunk;
+        {
+            unique_lock lock {state.buffersMutex};
+            state.buffersChanged.wait(lock, [&state] {
+                return !state.filledChunks.empty() || state.producersLeft == 0 || state.failed;
+            });
+            if (state.filledChunks.empty() || state.failed) break;
+
+            chunk = state.filledChunks.front();
+            state.filledChunks.pop_front();
+        }
+
+        auto [shardIt, opened] = openShards.try_emplace(chunk.shard);
+        OpenShard& shard = shardIt->second;
+        const filesystem::path path = filesystem::path(state.settings.directory) / format("shard_{:05}.bin", chunk.shard);
+
+        if (opened) {
+            shard.chunksLeft = state.layout.shardChunks(chunk.shard, state.settings.samples);
+            if (!shard.file.create(path.string(), state.settings.directIo)) {
+                cerr << format("Cannot create dataset shard '{}'\n", path.string());
+                state.fail();
+                break;
+            }
+            state.directIoRefused |= state.settings.directIo && !shard.file.direct;
+        }
+
+        const size_t length = alignToDirectIo(chunk.sampleCount * state.layout.sampleBytes);
+        if (!shard.file.writeAt(chunk.buffer, length, chunk.offset)) {
+            cerr << format("Cannot write dataset shard '{}'\n", path.string());
+            state.fail();
+            break;
+        }
+
+        {
+            lock_guard lock {state.buffersMutex};
+            state.freeBuffers.push_back(chunk.buffer);
+        }
+        state.buffersChanged.notify_all();
+
+        if (--shard.chunksLeft == 0) {
+            if (!finishShard(state, chunk.shard, shard.file)) {
+                cerr << format("Cannot complete dataset shard '{}'\n", path.string());
+                state.fail();
+                break;
+            }
+            openShards.erase(shardIt);
+        }
+    }
+}
+
+int runDatasetWriter(const DatasetSettings& settings) {
+    DatasetState state;
+    state.settings = settings;
+
+    DatasetLayout& layout = state.layout;
+    layout.worldSize = (max(settings.worldSize, 1) + 63) / 64 * 64;
+    layout.worldWords = layout.worldSize / 64;
+    layout.tileSize = settings.tileSize > 0 ? min(settings.tileSize, layout.worldSize) : layout.worldSize;
+    layout.rowWords = (layout.tileSize + 63) / 64;
+    layout.frameBytes = static_cast<size_t>(layout.tileSize) * layout.rowWords * sizeof(uint64_t);
+    layout.sampleBytes = layout.frameBytes * settings.framesPerSample;
+
+    // Whole buffers stay aligned for direct writes: round the samples per
+    // buffer to a multiple of the samples that fill whole blocks
+    const int64_t alignedRun = DIRECT_IO_ALIGNMENT / gcd(layout.sampleBytes, DIRECT_IO_ALIGNMENT);
+    layout.samplesPerBuffer = max<int64_t>(1, static_cast<int64_t>(DATASET_BUFFER_BYTES / layout.sampleBytes) / alignedRun) * alignedRun;
+    layout.samplesPerShard = min<int64_t>(settings.samplesPerShard, settings.samples);
+    layout.chunksPerShard = (layout.samplesPerShard + layout.samplesPerBuffer - 1) / layout.samplesPerBuffer;
+    layout.shardCount = (settings.samples + layout.samplesPerShard - 1) / layout.samplesPerShard;
+
+    if (layout.worldSize != settings.worldSize) {
+        cerr << format("Dataset worlds rounded up to {}x{} cells\n", layout.worldSize, layout.worldSize);
+    }
+
+    const int workerCount = settings.workerCount > 0
+        ? settings.workerCount : max(1, static_cast<int>(thread::hardware_concurrency()));
+
+    error_code error;
+    filesystem::create_directories(settings.directory, error);
+
+    // Two buffers per worker: one being filled while the other is written
+    const size_t bufferBytes = alignToDirectIo(layout.samplesPerBuffer * layout.sampleBytes);
+    vector<uint8_t*> buffers;
+    for (int i = 0; i < 2 * workerCount; i++) {
+        buffers.push_back(allocateAligned(bufferBytes));
+    }
+    state.freeBuffers = buffers;
+    state.producersLeft = workerCount;
+
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    thread writer {writeChunks, ref(state)};
+    vector<thread> workers;
+    for (int wi = 0; wi < workerCount; wi++) {
+        workers.emplace_back(produceChunks, ref(state));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    writer.join();
+
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    for (uint8_t* buffer : buffers) {
+        freeAligned(buffer);
+    }
+
+    if (state.failed) return 1;
+
+    if (state.directIoRefused) {
+        cerr << "Direct I/O is not supported for the dataset directory, shards were written through the page cache\n";
+    }
+
+    const double bytes = static_cast<double>(settings.samples) * static_cast<double>(layout.sampleBytes);
+    const double generationsPerSample = settings.warmup + static_cast<double>(settings.framesPerSample - 1) * settings.frameStride;
+    const double cells = static_cast<double>(layout.worldSize) * layout.worldSize * generationsPerSample * settings.samples;
+
+    cout << format("samples {}\nshards {}\nseconds {:.3f}\nsamples/s {:.1f}\nGB/s {:.3f}\ncells/s {:.3e}\nworker stall seconds {:.3f}\n",
+        settings.samples, layout.shardCount, seconds, settings.samples / seconds, bytes / seconds / 1e9,
+        cells / seconds, state.stallSeconds);
+
+    return 0;
+}
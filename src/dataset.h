@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include "seed.h"
+
+#include <cstdint>
+#include <string>
+
+// Training data shards: many small seeded worlds, each contributing one
+// sample of consecutive bit-packed frames (a (state, next state) pair by
+// default), cropped to a square tile.
+//
+// A shard file is a DatasetShardHeader padded to DATASET_HEADER_SIZE, the
+// samples back to back, each sampleBytes long with its frames in order and
+// every frame tileSize rows of rowWords words (cells LSB first, see
+// bitpack.h), and from indexOffset one DatasetIndexEntry per sample. All
+// fields are little-endian.
+constexpr char DATASET_MAGIC[8] = {'G', 'O', 'L', 'S', 'H', 'A', 'R', 'D'};
+constexpr uint32_t DATASET_VERSION = 1;
+constexpr uint32_t DATASET_HEADER_SIZE = 4096;
+
+struct DatasetShardHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t worldSize;        // sample worlds are worldSize x worldSize tori
+    uint32_t tileSize;         // frames are tileSize x tileSize cells
+    uint32_t rowWords;
+    uint32_t framesPerSample;
+    uint32_t frameStride;      // generations between frames
+    uint32_t warmup;           // generation of the first frame
+    uint64_t seed;             // sample n is the world of --seed <seed + n>
+    float density;
+    uint32_t sampleCount;
+    uint64_t sampleBytes;
+    uint64_t firstSample;      // number of the shard's first sample in the dataset
+    uint64_t indexOffset;
+};
+static_assert(sizeof(DatasetShardHeader) == 80);
+
+struct DatasetIndexEntry {
+    uint64_t sample;
+    uint64_t offset;           // of the sample's first frame in the shard
+    uint32_t top;              // tile position in the world, wrapping around
+    uint32_t left;
+};
+static_assert(sizeof(DatasetIndexEntry) == 24);
+
+struct DatasetSettings {
+    int64_t samples = 0;
+    std::string directory = ".";
+    int worldSize = 256;        // rounded up to a multiple of 64
+    int tileSize = 0;           // 0 = the whole world
+    int framesPerSample = 2;
+    int frameStride = 1;
+    int warmup = 0;
+    int samplesPerShard = 65536;
+    bool directIo = false;      // bypass the page cache when writing shards
+    int workerCount = 0;        // 0 = hardware concurrency
+    SeedSettings seed;          // region ignored
+};
+
+// Produces `samples` samples on the workers into shard_<n>.bin files and
+// prints a throughput summary. Workers fill large aligned buffers that one
+// writer thread stores, so they only wait when every buffer is queued for
+// a disk slower than the simulation.
+int runDatasetWriter(const DatasetSettings& settings);
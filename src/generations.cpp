@@ -0,0 +1,245 @@
+﻿#include "generations.h"
+#include "bitlife.h"
+#include "bitpack.h"
+#include "topology.h"
+#include "stochastic.h"
+
+#include <bit>
+#include <vector>
+
+using namespace std;
+
+int generationsPlaneCount(const int states) {
+    // The counter only holds dying states, 1 .. states - 2
+    return 1 + bit_width(static_cast<unsigned>(states - 2));
+}
+
+template<uint16_t Birth, uint16_t Survival, int States>
+struct FixedGenerationsRule {
+    static constexpr uint16_t birth() { return Birth; }
+    static constexpr uint16_t survival() { return Survival; }
+    static constexpr int states() { return States; }
+    static constexpr NeighbourhoodShape shape() { return NeighbourhoodShape::Moore; }
+    static constexpr bool stochastic() { return false; }
+};
+
+LifeRule generationsRule;
+
+// The shape stays a compile-time constant so the count costs no branch
+template<NeighbourhoodShape Shape, bool Stochastic>
+struct TableGenerationsRule {
+    static uint16_t birth() { return generationsRule.birth; }
+    static uint16_t survival() { return generationsRule.survival; }
+    static int states() { return generationsRule.states; }
+    static constexpr NeighbourhoodShape shape() { return Shape; }
+    static constexpr bool stochastic() { return Stochastic; }
+};
+
+// Streams of stochastic rules, see StochasticSettings
+BernoulliStream birthNoise;
+BernoulliStream survivalNoise;
+BernoulliStream flipNoise;
+
+template<NeighbourhoodShape Shape>
+NeighbourCount countShapeNeighbours(const EdgedRow& above, const EdgedRow& row, const EdgedRow& below,
+                                    const int i, const int wordCount, const int cellCount) {
+    if constexpr (Shape == NeighbourhoodShape::VonNeumann) {
+        return countVonNeumannNeighbours(above, row, below, i, wordCount, cellCount);
+    } else if constexpr (Shape == NeighbourhoodShape::Hexagonal) {
+        return countHexNeighbours(above, row, below, i, wordCount, cellCount);
+    } else {
+        return countNeighbours(above, row, below, i, wordCount, cellCount);
+    }
+}
+
+constexpr int MAX_COUNTER_PLANES = 8;
+
+template<typename Rule, bool TrackAge>
+void generationsStep(const World& worldNow, World& worldNext, const int minX, const int maxX) {
+    const int words = worldNow.PlaneRowWords;
+    const int counterPlanes = worldNow.PlaneCount - 1;
+    const uint64_t lastCounter = static_cast<uint64_t>(Rule::states() - 2);
+    const uint64_t lastMask = lastWordMask(N);
+
+    // Live cells of the halo rows above and below the world
+    thread_local vector<uint64_t> haloRows;
+    haloRows.resize(2 * static_cast<size_t>(words));
+    bool* haloScratch = paddedRowScratch(1);
+
+    const auto liveRow = [&](const int rowX) -> EdgedRow {
+        if (0 <= rowX && rowX < N) {
+            return {worldNow.planeRow(0, rowX), haloWest(rowX), haloEast(rowX)};
+        }
+        uint64_t* packed = haloRows.data() + (rowX < 0 ? 0 : words);
+        packCells(paddedRow(worldNow, rowX, haloScratch) + 1, N, packed);
+        return {packed, haloWest(rowX), haloEast(rowX)};
+    };
+
+    for (int x = minX; x < maxX; x++) {
+        const EdgedRow above = liveRow(x - 1);
+        const EdgedRow row = liveRow(x);
+        const EdgedRow below = liveRow(x + 1);
+        uint64_t* next = worldNext.planeRow(0, x);
+
+        const uint64_t* counter[MAX_COUNTER_PLANES];
+        uint64_t* nextCounter[MAX_COUNTER_PLANES];
+        for (int p = 0; p < counterPlanes; p++) {
+            counter[p] = worldNow.planeRow(1 + p, x);
+            nextCounter[p] = worldNext.planeRow(1 + p, x);
+        }
+
+        for (int i = 0; i < words; i++) {
+            const NeighbourCount count = countShapeNeighbours<Rule::shape()>(above, row, below, i, words, N);
+            const uint64_t alive = row.cells[i];
+
+            // Dying cells, and those among them in the last dying state
+            uint64_t dying = 0;
+            uint64_t expiring = ~0ull;
+            for (int p = 0; p < counterPlanes; p++) {
+                dying |= counter[p][i];
+                expiring &= lastCounter >> p & 1 ? counter[p][i] : ~counter[p][i];
+            }
+            expiring &= dying;
+
+            // Random words numbered by generation and position, so the same
+            // cells get the same bits whichever worker steps them
+            uint64_t births = ~0ull;
+            uint64_t survivals = ~0ull;
+            uint64_t flips = 0;
+            if constexpr (Rule::stochastic()) {
+                const uint64_t noiseCounter = (static_cast<uint64_t>(worldNow.Generation) * N + x) * words + i;
+                births = birthNoise.word(noiseCounter);
+                survivals = survivalNoise.word(noiseCounter);
+                flips = flipNoise.word(noiseCounter);
+            }
+
+            const uint64_t born = ~alive & ~dying & countInMask(count, Rule::birth()) & births;
+            const uint64_t survives = alive & countInMask(count, Rule::survival()) & survivals;
+            next[i] = (born | survives) & (i == words - 1 ? lastMask : ~0ull);
+
+            // Dying cells count up, expiring ones become dead and live
+            // cells that don't survive start dying at 1
+            uint64_t carry = dying;
+            for (int p = 0; p < counterPlanes; p++) {
+                const uint64_t bits = counter[p][i];
+                nextCounter[p][i] = (bits ^ carry) & ~expiring;
+                carry &= bits;
+            }
+            if (counterPlanes > 0) nextCounter[0][i] |= alive & ~survives;
+
+            if constexpr (Rule::stochastic()) {
+                uint64_t nextDying = 0;
+                for (int p = 0; p < counterPlanes; p++) {
+                    nextDying |= nextCounter[p][i];
+                }
+                next[i] ^= flips & ~nextDying & (i == words - 1 ? lastMask : ~0ull);
+            }
+        }
+
+        unpackCells(next, N, worldNext.Data[x]);
+
+        if constexpr (TrackAge) {
+            for (int y = 0; y < N; y++) {
+                updateAge<true>(worldNow, worldNext, x, y);
+            }
+        }
+    }
+}
+
+template<typename Rule>
+void setKernels(StepKernel& step, StepKernel& stepWithAge) {
+    step = generationsStep<Rule, false>;
+    stepWithAge = generationsStep<Rule, true>;
+}
+
+template<bool Stochastic>
+void setShapeKernels(const NeighbourhoodShape shape, StepKernel& step, StepKernel& stepWithAge) {
+    if (shape == NeighbourhoodShape::VonNeumann) {
+        setKernels<TableGenerationsRule<NeighbourhoodShape::VonNeumann, Stochastic>>(step, stepWithAge);
+    } else if (shape == NeighbourhoodShape::Hexagonal) {
+        setKernels<TableGenerationsRule<NeighbourhoodShape::Hexagonal, Stochastic>>(step, stepWithAge);
+    } else {
+        setKernels<TableGenerationsRule<NeighbourhoodShape::Moore, Stochastic>>(step, stepWithAge);
+    }
+}
+
+void generationsKernels(const LifeRule& rule, StepKernel& step, StepKernel& stepWithAge) {
+    if (const StochasticSettings& settings = stochasticSettings(); settings.enabled()) {
+        generationsRule = rule;
+        birthNoise = {settings.seed, 0, settings.birth};
+        survivalNoise = {settings.seed, 1, settings.survival};
+        flipNoise = {settings.seed, 2, settings.flip};
+        setShapeKernels<true>(rule.shape, step, stepWithAge);
+    } else if (rule == LifeRule {countMask("2"), countMask(""), 3}) {
+        setKernels<FixedGenerationsRule<countMask("2"), countMask(""), 3>>(step, stepWithAge);          // Brian's Brain
+    } else if (rule == LifeRule {countMask("2"), countMask("345"), 4}) {
+        setKernels<FixedGenerationsRule<countMask("2"), countMask("345"), 4>>(step, stepWithAge);       // Star Wars
+    } else if (rule == LifeRule {countMask("34"), countMask("12"), 3}) {
+        setKernels<FixedGenerationsRule<countMask("34"), countMask("12"), 3>>(step, stepWithAge);       // Frogs
+    } else {
+        generationsRule = rule;
+        setShapeKernels<false>(rule.shape, step, stepWithAge);
+    }
+}
+
+void prepareGenerationsWorlds(const int index) {
+    const int states = simRule().life.states;
+    const int planeCount = generationsPlaneCount(states);
+    const int rowWords = packedWordCount(N);
+    const size_t planeWords = static_cast<size_t>(planeCount) * N * rowWords;
+
+    // Planes restored from a checkpoint already hold the dying states
+    World& world = worlds[index];
+    const bool hasPlanes = world.PlaneCount == planeCount && world.PlaneRowWords == rowWords
+        && world.Planes.size() == planeWords;
+
+    for (World& other : worlds) {
+        if (&other == &world && hasPlanes) continue;
+        other.PlaneCount = planeCount;
+        other.PlaneRowWords = rowWords;
+        other.Planes.assign(planeWords, 0);
+    }
+    if (hasPlanes) return;
+
+    // Otherwise the states of a multi-state pattern, or just the live cells
+    if (world.States.empty()) {
+        for (int x = 0; x < N; x++) {
+            packCells(world.Data[x], N, world.planeRow(0, x));
+        }
+        return;
+    }
+
+    for (int x = 0; x < N; x++) {
+        const uint8_t* row = world.stateRow(x);
+        for (int y = 0; y < N; y++) {
+            const int state = row[y] < states ? row[y] : 0;
+            const uint64_t bit = 1ull << (y % 64);
+            const int counter = state > 1 ? state - 1 : 0;
+
+            world.Data[x][y] = state == 1;
+            if (state == 1) world.planeRow(0, x)[y / 64] |= bit;
+            for (int p = 1; p < planeCount; p++) {
+                if (counter >> (p - 1) & 1) world.planeRow(p, x)[y / 64] |= bit;
+            }
+        }
+    }
+
+    for (World& other : worlds) {
+        other.States.clear();
+    }
+}
+
+void unpackGenerationsStates(const World& world, const int x, uint8_t* states) {
+    for (int y = 0; y < N; y++) {
+        const int word = y / 64;
+        const int bit = y % 64;
+
+        int counter = 0;
+        for (int p = 1; p < world.PlaneCount; p++) {
+            counter |= static_cast<int>(world.planeRow(p, x)[word] >> bit & 1) << (p - 1);
+        }
+
+        const bool alive = world.planeRow(0, x)[word] >> bit & 1;
+        states[y] = static_cast<uint8_t>(alive ? 1 : counter == 0 ? 0 : counter + 1);
+    }
+}
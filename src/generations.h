@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include "sim.h"
+
+#include <cstdint>
+
+// Generations rules (see LifeRule) on the bit planes of World: plane 0 holds
+// the live cells, the planes after it the dying states as a binary counter,
+// state - 1 for dying cells and 0 otherwise. A step is then bitwise logic on
+// 64 cells at a time, the counter advancing by a ripple-carry increment.
+//
+// Two-state rules on the von Neumann or hexagonal neighbourhood run here too,
+// with no counter planes, and stochastic rules (see stochastic.h).
+int generationsPlaneCount(int states);
+
+// Step kernels for a Generations rule, without and with World::Age upkeep.
+// Brian's Brain, Star Wars and Frogs are specialized at compile time, and
+// the neighbourhood shape of any rule, and whether it is stochastic.
+void generationsKernels(const LifeRule& rule, StepKernel& step, StepKernel& stepWithAge);
+
+// Sizes the planes of the three world buffers for the current rule. Those of
+// worlds[index] are kept when restored with it, else filled from the states
+// of a multi-state pattern in World::States, which are then dropped, or from
+// its Data with no dying cells.
+void prepareGenerationsWorlds(int index);
+
+// States of row x, 0 dead, 1 alive, 2 .. states - 1 dying.
+void unpackGenerationsStates(const World& world, int x, uint8_t* states);
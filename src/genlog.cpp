@@ -0,0 +1,348 @@
+﻿#include "genlog.h"
+#include "packed_world.h"
+#include "sim.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+constexpr int LOG_QUEUE_CAPACITY = 64;
+
+constexpr uint8_t FRAME_KEY = 0;
+constexpr uint8_t FRAME_DELTA = 1;
+
+struct FooterRecord {
+    uint64_t indexOffset;
+    uint64_t frameCount;
+    char magic[8];
+};
+
+struct PackedFrame {
+    vector<uint64_t> words = vector<uint64_t>(packedWorldWords());
+};
+
+mutex genLogMutex;
+condition_variable logFrameFreed;
+condition_variable logFrameQueued;
+vector<unique_ptr<PackedFrame>> freeLogFrames;
+deque<unique_ptr<PackedFrame>> queuedLogFrames;
+bool genLogStopping = false;
+atomic<bool> genLogActive {false};
+
+FILE* genLogFile = nullptr;
+uint64_t genLogSize = 0;
+vector<uint64_t> genLogFrameOffsets;
+thread genLogWriter;
+
+void writeGenerationLogFrames(const int keyframeInterval) {
+    const size_t wordCount = packedWorldWords();
+    vector<uint64_t> previous(wordCount);
+    vector<uint64_t> delta(wordCount);
+    vector<uint8_t> frameBytes;
+    vector<uint8_t> payload;
+
+    while (true) {
+        unique_ptr<PackedFrame> frame;
+        {
+            unique_lock lock(genLogMutex);
+            logFrameQueued.wait(lock, [] { return genLogStopping || !queuedLogFrames.empty(); });
+            if (queuedLogFrames.empty()) return;
+
+            frame = move(queuedLogFrames.front());
+            queuedLogFrames.pop_front();
+        }
+
+        const bool keyframe = genLogFrameOffsets.size() % keyframeInterval == 0;
+
+        frameBytes.clear();
+        frameBytes.push_back(keyframe ? FRAME_KEY : FRAME_DELTA);
+
+        payload.clear();
+        if (keyframe) {
+            encodeWords(frame->words.data(), wordCount, payload);
+        } else {
+            for (size_t i = 0; i < wordCount; i++) {
+                delta[i] = frame->words[i] ^ previous[i];
+            }
+            encodeWords(delta.data(), wordCount, payload);
+        }
+        putVarint(frameBytes, payload.size());
+
+        // The frame becomes the new reference, its old buffer goes back to the pool
+        swap(previous, frame->words);
+        {
+            lock_guard lock(genLogMutex);
+            freeLogFrames.push_back(move(frame));
+        }
+        logFrameFreed.notify_one();
+
+        fwrite(frameBytes.data(), 1, frameBytes.size(), genLogFile);
+        fwrite(payload.data(), 1, payload.size(), genLogFile);
+
+        genLogFrameOffsets.push_back(genLogSize);
+        genLogSize += frameBytes.size() + payload.size();
+    }
+}
+
+void queueLogFrame(const World& world, const bool wait) {
+    unique_ptr<PackedFrame> frame;
+    {
+        unique_lock lock(genLogMutex);
+        if (wait) {
+            logFrameFreed.wait(lock, [] { return !freeLogFrames.empty(); });
+        }
+        frame = move(freeLogFrames.back());
+        freeLogFrames.pop_back();
+    }
+
+    packWorld(world, frame->words.data());
+
+    {
+        lock_guard lock(genLogMutex);
+        queuedLogFrames.push_back(move(frame));
+    }
+    logFrameQueued.notify_one();
+}
+
+bool startGenerationLog(const string& path, const int keyframeInterval, const World& initialWorld, const string& rule) {
+    if (path.empty()) return true;
+
+    genLogFile = fopen(path.c_str(), "wb");
+    if (genLogFile == nullptr) {
+        cerr << format("Cannot create generation log '{}'\n", path);
+        return false;
+    }
+    setvbuf(genLogFile, nullptr, _IOFBF, 1 << 20);
+
+    GenerationLogHeader header {};
+    memcpy(header.magic, GENLOG_MAGIC, sizeof(header.magic));
+    header.version = GENLOG_VERSION;
+    header.width = N;
+    header.height = N;
+    header.keyframeInterval = static_cast<uint32_t>(max(1, keyframeInterval));
+    header.firstGeneration = static_cast<uint64_t>(initialWorld.Generation);
+    rule.copy(header.rule, sizeof(header.rule) - 1);
+    fwrite(&header, sizeof(header), 1, genLogFile);
+    genLogSize = sizeof(header);
+
+    // Frames of an earlier run in this process may have another size
+    genLogStopping = false;
+    genLogFrameOffsets.clear();
+    freeLogFrames.clear();
+
+    for (int i = 0; i < LOG_QUEUE_CAPACITY; i++) {
+        freeLogFrames.push_back(make_unique<PackedFrame>());
+    }
+
+    genLogWriter = thread{writeGenerationLogFrames, static_cast<int>(header.keyframeInterval)};
+
+    queueLogFrame(initialWorld, false);
+    genLogActive = true;
+
+    return true;
+}
+
+void generationLogCapture(const World& world) {
+    if (!genLogActive) return;
+
+    queueLogFrame(world, true);
+}
+
+void stopGenerationLog() {
+    if (!genLogActive) return;
+    genLogActive = false;
+
+    {
+        lock_guard lock(genLogMutex);
+        genLogStopping = true;
+    }
+    logFrameQueued.notify_all();
+    genLogWriter.join();
+
+    FooterRecord footer {};
+    footer.indexOffset = genLogSize;
+    footer.frameCount = genLogFrameOffsets.size();
+    memcpy(footer.magic, GENLOG_INDEX_MAGIC, sizeof(footer.magic));
+
+    fwrite(genLogFrameOffsets.data(), sizeof(uint64_t), genLogFrameOffsets.size(), genLogFile);
+    fwrite(&footer, sizeof(footer), 1, genLogFile);
+
+    if (ferror(genLogFile)) {
+        cerr << "Failed to write the generation log\n";
+    }
+    fclose(genLogFile);
+    genLogFile = nullptr;
+
+    cerr << format("Logged {} generations\n", footer.frameCount);
+}
+
+
+bool GenerationLogReader::open(const string& path) {
+    if (!file.map(path) || file.size < sizeof(GenerationLogHeader)) {
+        cerr << format("Cannot map generation log '{}'\n", path);
+        return false;
+    }
+
+    memcpy(&header, file.data, sizeof(header));
+    if (memcmp(header.magic, GENLOG_MAGIC, sizeof(header.magic)) != 0 || header.version != GENLOG_VERSION
+        || header.keyframeInterval == 0) {
+        cerr << format("'{}' is not a version {} generation log\n", path, GENLOG_VERSION);
+        return false;
+    }
+    if (header.width != static_cast<uint32_t>(N) || header.height != static_cast<uint32_t>(N)) {
+        cerr << format("Generation log '{}' is {}x{}, the world is {}x{} (see --size)\n", path, header.width, header.height, N, N);
+        return false;
+    }
+    rule.assign(header.rule, strnlen(header.rule, sizeof(header.rule)));
+
+    FooterRecord footer {};
+    if (file.size >= sizeof(header) + sizeof(footer)) {
+        memcpy(&footer, file.data + file.size - sizeof(footer), sizeof(footer));
+    }
+
+    // Each bound on its own, sums of untrusted fields could wrap around
+    bool indexed = memcmp(footer.magic, GENLOG_INDEX_MAGIC, sizeof(footer.magic)) == 0
+        && footer.indexOffset >= sizeof(header)
+        && footer.indexOffset <= file.size - sizeof(footer)
+        && (file.size - sizeof(footer) - footer.indexOffset) % sizeof(uint64_t) == 0
+        && footer.frameCount == (file.size - sizeof(footer) - footer.indexOffset) / sizeof(uint64_t);
+
+    if (indexed) {
+        frameOffsets.resize(footer.frameCount);
+        memcpy(frameOffsets.data(), file.data + footer.indexOffset, footer.frameCount * sizeof(uint64_t));
+
+        // Frames lie between the header and the index, a damaged index is recovered from
+        indexed = all_of(frameOffsets.begin(), frameOffsets.end(), [&](const uint64_t offset) {
+            return sizeof(header) <= offset && offset < footer.indexOffset;
+        });
+    }
+
+    if (!indexed) {
+        if (!rebuildIndex()) {
+            cerr << format("Generation log '{}' has no readable frames\n", path);
+            return false;
+        }
+        cerr << format("Generation log '{}' has no usable index, recovered {} frames\n", path, frameOffsets.size());
+    }
+
+    words.assign(packedWorldWords(), 0);
+    return !frameOffsets.empty();
+}
+
+// A log whose writer died has no index; recover every complete frame.
+bool GenerationLogReader::rebuildIndex() {
+    const uint8_t* const end = file.data + file.size;
+    const uint8_t* in = file.data + sizeof(GenerationLogHeader);
+
+    frameOffsets.clear();
+    while (in < end && (*in == FRAME_KEY || *in == FRAME_DELTA)) {
+        const uint8_t* frame = in++;
+        uint64_t payloadSize;
+        if (!getVarint(in, end, payloadSize) || static_cast<uint64_t>(end - in) < payloadSize) break;
+
+        frameOffsets.push_back(static_cast<uint64_t>(frame - file.data));
+        in += payloadSize;
+    }
+
+    return !frameOffsets.empty();
+}
+
+bool GenerationLogReader::decodeFrame(const size_t frame) {
+    const uint8_t* const end = file.data + file.size;
+    const uint8_t* in = file.data + frameOffsets[frame];
+
+    uint64_t payloadSize = 0;
+    const uint8_t tag = *in++;
+    const bool decoded = (tag == FRAME_KEY || tag == FRAME_DELTA)
+        && getVarint(in, end, payloadSize) && static_cast<uint64_t>(end - in) >= payloadSize
+        && decodeWords(in, in + payloadSize, words.data(), packedWorldWords(), tag == FRAME_KEY);
+
+    if (!decoded) {
+        cerr << format("Generation log frame {} is damaged\n", frame);
+    }
+    return decoded;
+}
+
+bool GenerationLogReader::seek(int target) {
+    target = clamp(target, firstGeneration(), lastGeneration());
+
+    const size_t frame = static_cast<size_t>(target - firstGeneration());
+    size_t decodeFrom = frame - frame % header.keyframeInterval;
+
+    // Moving forward inside the current keyframe block only needs the deltas in between
+    if (generation >= firstGeneration() && generation < target) {
+        decodeFrom = max(decodeFrom, static_cast<size_t>(generation - firstGeneration()) + 1);
+    }
+
+    for (size_t i = decodeFrom; i <= frame; i++) {
+        if (!decodeFrame(i)) return false;
+    }
+
+    generation = target;
+    return true;
+}
+
+bool GenerationLogReader::next() {
+    if (generation >= lastGeneration()) return false;
+
+    if (!decodeFrame(static_cast<size_t>(generation + 1 - firstGeneration()))) return false;
+
+    ++generation;
+    return true;
+}
+
+void GenerationLogReader::unpack(World& world) const {
+    unpackWorld(words.data(), world);
+    world.Generation = generation;
+}
+
+
+unique_ptr<GenerationLogReader> replayReader;
+bool replayHoldAtEnd = false;
+atomic<int> replaySeekTarget {-1};
+
+int replayNextGeneration(World& next) {
+    if (const int target = replaySeekTarget.exchange(-1); target >= 0) {
+        if (!replayReader->seek(target)) return SOURCE_EXHAUSTED;
+    } else if (!replayReader->next()) {
+        return replayHoldAtEnd ? SOURCE_IDLE : SOURCE_EXHAUSTED;
+    }
+
+    replayReader->unpack(next);
+    return replayReader->generation;
+}
+
+bool startReplay(const string& path, const int fromGeneration, const bool holdAtEnd) {
+    replayReader = make_unique<GenerationLogReader>();
+    if (!replayReader->open(path)) return false;
+
+    const int start = max(fromGeneration, replayReader->firstGeneration());
+    if (!replayReader->seek(start)) {
+        cerr << format("Cannot seek generation log '{}' to {}\n", path, start);
+        return false;
+    }
+
+    World& initialWorld = worlds[WorldIndices{worldIndicesStore.load()}.simOld];
+    replayReader->unpack(initialWorld);
+    simIndex = replayReader->generation;
+
+    replayHoldAtEnd = holdAtEnd;
+    setGenerationSource(replayNextGeneration);
+
+    cerr << format("Replaying generations {} to {}\n", replayReader->generation, replayReader->lastGeneration());
+    return true;
+}
+
+void requestReplaySeek(const int generation) {
+    replaySeekTarget = max(0, generation);
+}
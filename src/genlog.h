@@ -0,0 +1,75 @@
+﻿#pragma once
+
+#include "world.h"
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Generation log layout, little-endian:
+//   GenerationLogHeader
+//   frames: u8 type, varint payload size, payload
+//   index: u64 file offset of every frame
+//   footer: u64 index offset, u64 frame count, GENLOG_INDEX_MAGIC
+//
+// Frame i holds generation firstGeneration + i. Every keyframeInterval-th
+// frame is a keyframe coding the bit-packed world itself, the others code
+// the XOR with the previous generation. Payloads are a sequence of
+// (varint zero word run, varint literal word count, literal words).
+constexpr uint32_t GENLOG_VERSION = 1;
+constexpr char GENLOG_MAGIC[8] = {'G', 'O', 'L', 'D', 'L', 'O', 'G', '\0'};
+constexpr char GENLOG_INDEX_MAGIC[8] = {'G', 'O', 'L', 'D', 'I', 'D', 'X', '\0'};
+
+struct GenerationLogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t keyframeInterval;
+    uint64_t firstGeneration;
+    char rule[64];
+};
+
+// Starts logging with `initialWorld` as the first keyframe. Every generation
+// after it must then be captured, in order.
+bool startGenerationLog(const std::string& path, int keyframeInterval, const World& initialWorld, const std::string& rule);
+
+// Called by the sim thread for every completed generation. Packs the world
+// into a free slot; XOR, coding and I/O happen on the log writer thread. The
+// log must not have gaps, so the sim waits when all slots are in flight.
+void generationLogCapture(const World& world);
+
+void stopGenerationLog();
+
+struct GenerationLogReader {
+    bool open(const std::string& path);
+
+    // Decodes the keyframe at or before `target` and applies the deltas up
+    // to it, so a seek costs at most keyframeInterval frame decodes.
+    bool seek(int target);
+    bool next();
+
+    void unpack(World& world) const;
+
+    int firstGeneration() const { return static_cast<int>(header.firstGeneration); }
+    int lastGeneration() const { return firstGeneration() + static_cast<int>(frameOffsets.size()) - 1; }
+
+    int generation = -1;
+    std::string rule;
+
+private:
+    bool rebuildIndex();
+    bool decodeFrame(size_t frame);
+
+    MappedFile file;
+    GenerationLogHeader header {};
+    std::vector<uint64_t> frameOffsets;
+    std::vector<uint64_t> words;
+};
+
+// Feeds the sim loop from a generation log instead of simulating, starting
+// at `fromGeneration`. With holdAtEnd the replay idles on the last frame
+// (waiting for seeks) instead of stopping the sim.
+bool startReplay(const std::string& path, int fromGeneration, bool holdAtEnd);
+void requestReplaySeek(int generation);
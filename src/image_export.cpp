@@ -0,0 +1,105 @@
+﻿#include "image_export.h"
+
+#include "external/stb_image_write.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// Like packCells, but MSB first as PBM wants it: the multiply moves the low
+// bit of byte i to bit 63 - i of the product.
+uint8_t packEightCellsMsbFirst(const bool* cells) {
+    constexpr uint64_t GATHER_REVERSED = 0x8040201008040201ull;
+
+    uint64_t eightCells;
+    memcpy(&eightCells, cells, sizeof(eightCells));
+    return static_cast<uint8_t>((eightCells * GATHER_REVERSED) >> 56);
+}
+
+bool exportPbm(const string& path, const World& world) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        cerr << format("Cannot create '{}'\n", path);
+        return false;
+    }
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+    fputs(format("P4\n{} {}\n", N, N).c_str(), file);
+
+    vector<uint8_t> row((N + 7) / 8);
+    for (int x = 0; x < N; x++) {
+        const bool* cells = world.Data[x];
+
+        int y = 0;
+        for (; y + 8 <= N; y += 8) {
+            row[y / 8] = packEightCellsMsbFirst(cells + y);
+        }
+        if (y < N) {
+            uint8_t last = 0;
+            for (int i = 0; y + i < N; i++) {
+                last |= static_cast<uint8_t>(cells[y + i]) << (7 - i);
+            }
+            row[y / 8] = last;
+        }
+
+        fwrite(row.data(), 1, row.size(), file);
+    }
+
+    const bool ok = !ferror(file);
+    fclose(file);
+    if (!ok) {
+        cerr << format("Failed to write '{}'\n", path);
+    }
+    return ok;
+}
+
+bool exportPng(const string& path, const World& world, const int tileSize) {
+    const int tile = max(1, tileSize);
+    const bool tiled = N > tile;
+
+    const filesystem::path basePath {path};
+    vector<uint8_t> pixels(static_cast<size_t>(min(N, tile)) * min(N, tile));
+
+    for (int top = 0; top < N; top += tile) {
+        for (int left = 0; left < N; left += tile) {
+            const int height = min(tile, N - top);
+            const int width = min(tile, N - left);
+
+            for (int x = 0; x < height; x++) {
+                const bool* cells = world.Data[top + x] + left;
+                uint8_t* pixelRow = pixels.data() + static_cast<size_t>(x) * width;
+                for (int y = 0; y < width; y++) {
+                    pixelRow[y] = cells[y] ? 0xFF : 0x00;
+                }
+            }
+
+            filesystem::path tilePath = basePath;
+            if (tiled) {
+                tilePath.replace_filename(format("{}_{}_{}.png", basePath.stem().string(), top, left));
+            }
+
+            if (!stbi_write_png(tilePath.string().c_str(), width, height, 1, pixels.data(), width)) {
+                cerr << format("Failed to write '{}'\n", tilePath.string());
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool exportImage(const string& path, const World& world, const int tileSize) {
+    const string extension = filesystem::path {path}.extension().string();
+
+    if (extension == ".pbm") return exportPbm(path, world);
+    if (extension == ".png") return exportPng(path, world, tileSize);
+
+    cerr << format("Cannot tell the image format of '{}', use .pbm or .png\n", path);
+    return false;
+}
@@ -0,0 +1,23 @@
+﻿#pragma once
+
+#include "world.h"
+
+#include <string>
+
+// Full-resolution images of a world, one pixel per cell, without going
+// through the window. Rows are the world's x index, like the render.
+//
+// PBM (P4): 1 bit per cell, live cells are 1 (black). Written row by row,
+// so any size streams through a one-row buffer.
+//
+// PNG: 8-bit gray, live cells white, encoded by stb_image_write. The encoder
+// needs the whole image in memory, so worlds larger than `tileSize` are cut
+// into tiles written as <stem>_<row>_<column>.png next to `path`, each tile
+// covering tileSize x tileSize cells starting at (row, column).
+constexpr int DEFAULT_EXPORT_TILE_SIZE = 4096;
+
+bool exportPbm(const std::string& path, const World& world);
+bool exportPng(const std::string& path, const World& world, int tileSize = DEFAULT_EXPORT_TILE_SIZE);
+
+// Picks the format from the extension, .pbm or .png.
+bool exportImage(const std::string& path, const World& world, int tileSize = DEFAULT_EXPORT_TILE_SIZE);
@@ -0,0 +1,48 @@
+﻿#include "isotropic.h"
+#include "topology.h"
+
+using namespace std;
+
+// Next state by 3x3 neighbourhood index
+bool isotropicTable[512];
+
+// Column y of the padded rows above, at and below, in the east column of an index
+inline int neighbourhoodColumn(const bool* above, const bool* row, const bool* below, const int y) {
+    return above[y] | row[y] << 3 | below[y] << 6;
+}
+
+template<bool TrackAge>
+void isotropicStep(const World& worldNow, World& worldNext, const int minX, const int maxX) {
+    // Keeps the middle and east columns when moving one column east
+    constexpr int KEEP_MASK = 0b011011011;
+
+    PaddedRows<bool> rows;
+    rows.start(worldNow, minX);
+
+    for (int x = minX; x < maxX; x++) {
+        if (x > minX) rows.next(worldNow);
+
+        const bool* above = rows.above;
+        const bool* row = rows.row;
+        const bool* below = rows.below;
+        bool* next = worldNext.Data[x];
+
+        // Padded column y + 1 is world column y
+        int index = neighbourhoodColumn(above, row, below, 0) << 1 | neighbourhoodColumn(above, row, below, 1);
+
+        for (int y = 0; y < N; y++) {
+            index = (index & KEEP_MASK) << 1 | neighbourhoodColumn(above, row, below, y + 2);
+            next[y] = isotropicTable[index];
+            updateAge<TrackAge>(worldNow, worldNext, x, y);
+        }
+    }
+}
+
+void isotropicKernels(const IsotropicRule& rule, StepKernel& step, StepKernel& stepWithAge) {
+    for (int index = 0; index < 512; index++) {
+        isotropicTable[index] = rule.next(index);
+    }
+
+    step = isotropicStep<false>;
+    stepWithAge = isotropicStep<true>;
+}
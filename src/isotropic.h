@@ -0,0 +1,9 @@
+﻿#pragma once
+
+#include "sim.h"
+
+// Isotropic non-totalistic rules (see IsotropicRule). Each row is walked
+// with the 9-bit index of the current 3x3 neighbourhood: moving one cell
+// along shifts the index by a column and ORs in the column entering on the
+// right, so a cell costs three loads and one table lookup.
+void isotropicKernels(const IsotropicRule& rule, StepKernel& step, StepKernel& stepWithAge);
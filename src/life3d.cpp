@@ -0,0 +1,228 @@
+﻿#include "life3d.h"
+#include "bitlife.h"
+#include "bitpack.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+using namespace std;
+
+// Counts of 64 cells, bit b of the count of cell j in bit j of word b
+template<size_t Bits>
+using SlicedCount = array<uint64_t, Bits>;
+
+// a + b + c with two ripple-carry additions, in enough bits for the sum
+template<size_t Bits, size_t InputBits>
+SlicedCount<Bits> addCounts(const SlicedCount<InputBits>& a, const SlicedCount<InputBits>& b, const SlicedCount<InputBits>& c) {
+    SlicedCount<Bits> sum {};
+    uint64_t carry = 0;
+    for (size_t bit = 0; bit < Bits; bit++) {
+        const uint64_t x = bit < InputBits ? a[bit] : 0;
+        const uint64_t y = bit < InputBits ? b[bit] : 0;
+        sum[bit] = x ^ y ^ carry;
+        carry = (x & y) | (carry & (x ^ y));
+    }
+
+    carry = 0;
+    for (size_t bit = 0; bit < Bits; bit++) {
+        const uint64_t x = sum[bit];
+        const uint64_t y = bit < InputBits ? c[bit] : 0;
+        sum[bit] = x ^ y ^ carry;
+        carry = (x & y) | (carry & (x ^ y));
+    }
+    return sum;
+}
+
+// Cells whose count is in `set`, bit n for count n
+template<size_t Bits>
+uint64_t countInSet(const SlicedCount<Bits>& count, const uint32_t set) {
+    uint64_t cells = 0;
+    for (int n = 0; n < 1 << Bits; n++) {
+        if (!(set >> n & 1)) continue;
+
+        uint64_t matching = ~0ull;
+        for (size_t bit = 0; bit < Bits; bit++) {
+            matching &= n >> bit & 1 ? count[bit] : ~count[bit];
+        }
+        cells |= matching;
+    }
+    return cells;
+}
+
+// Totals over the 27 cells of the cube around a cell, itself included, that
+// give a live cell: births for dead cells and survivals, one more, for live ones
+uint32_t birthTotals = 0;
+uint32_t survivalTotals = 0;
+
+// Sums over the 3 x 3 cells around each cell of slice z, 0 to 9
+void sliceSums(const World& world, const int z, SlicedCount<4>* sums) {
+    const int words = world.PlaneRowWords;
+    const int lastBit = (N - 1) % 64;
+
+    thread_local vector<SlicedCount<2>> rowSums;
+    rowSums.resize(static_cast<size_t>(N) * words);
+
+    for (int x = 0; x < N; x++) {
+        const uint64_t* cells = world.planeRow(z, x);
+        const EdgedRow row {cells, (cells[words - 1] >> lastBit & 1) != 0, (cells[0] & 1) != 0};
+
+        for (int i = 0; i < words; i++) {
+            const SumBits sum = addBits(westOf(row, i), cells[i], eastOf(row, i, words, N));
+            rowSums[static_cast<size_t>(x) * words + i] = {sum.sum, sum.carry};
+        }
+    }
+
+    for (int x = 0; x < N; x++) {
+        const SlicedCount<2>* above = rowSums.data() + static_cast<size_t>(x == 0 ? N - 1 : x - 1) * words;
+        const SlicedCount<2>* row = rowSums.data() + static_cast<size_t>(x) * words;
+        const SlicedCount<2>* below = rowSums.data() + static_cast<size_t>(x == N - 1 ? 0 : x + 1) * words;
+
+        for (int i = 0; i < words; i++) {
+            sums[static_cast<size_t>(x) * words + i] = addCounts<4>(above[i], row[i], below[i]);
+        }
+    }
+}
+
+void life3dStep(const World& worldNow, World& worldNext, const int minZ, const int maxZ) {
+    if (minZ >= maxZ) return;
+
+    const int words = worldNow.PlaneRowWords;
+    const size_t sliceCounts = static_cast<size_t>(N) * words;
+    const uint64_t lastMask = lastWordMask(N);
+
+    // The sums of slices z - 1, z and z + 1, in a ring
+    thread_local vector<SlicedCount<4>> sums;
+    sums.resize(3 * sliceCounts);
+    const auto sumsOf = [&](const int z) { return sums.data() + (z + 3) % 3 * sliceCounts; };
+    const auto wrap = [](const int z) { return (z + N) % N; };
+
+    sliceSums(worldNow, wrap(minZ - 1), sumsOf(minZ - 1));
+    sliceSums(worldNow, minZ, sumsOf(minZ));
+
+    for (int z = minZ; z < maxZ; z++) {
+        sliceSums(worldNow, wrap(z + 1), sumsOf(z + 1));
+
+        const SlicedCount<4>* back = sumsOf(z - 1);
+        const SlicedCount<4>* middle = sumsOf(z);
+        const SlicedCount<4>* front = sumsOf(z + 1);
+
+        for (int x = 0; x < N; x++) {
+            const uint64_t* cells = worldNow.planeRow(z, x);
+            uint64_t* next = worldNext.planeRow(z, x);
+            const size_t rowStart = static_cast<size_t>(x) * words;
+
+            for (int i = 0; i < words; i++) {
+                const SlicedCount<5> total = addCounts<5>(back[rowStart + i], middle[rowStart + i], front[rowStart + i]);
+                const uint64_t alive = cells[i];
+
+                next[i] = ((~alive & countInSet(total, birthTotals)) | (alive & countInSet(total, survivalTotals)))
+                    & (i == words - 1 ? lastMask : ~0ull);
+            }
+        }
+    }
+}
+
+void life3dKernels(const Life3DRule& rule, StepKernel& step, StepKernel& stepWithAge) {
+    birthTotals = 0;
+    survivalTotals = 0;
+    for (int count = rule.birthMin; count <= rule.birthMax; count++) {
+        birthTotals |= 1u << count;
+    }
+    for (int count = rule.survivalMin; count <= rule.survivalMax; count++) {
+        survivalTotals |= 1u << (count + 1);
+    }
+
+    // Ages belong to the view, finishLife3DStep keeps them
+    step = life3dStep;
+    stepWithAge = life3dStep;
+}
+
+void prepareLife3DWorlds(const int index) {
+    const int rowWords = packedWordCount(N);
+    const size_t volumeWords = static_cast<size_t>(N) * N * rowWords;
+
+    World& world = worlds[index];
+    const bool hasVolume = world.PlaneCount == N && world.PlaneRowWords == rowWords && world.Planes.size() == volumeWords;
+
+    for (World& other : worlds) {
+        if (&other == &world && hasVolume) continue;
+        other.PlaneCount = N;
+        other.PlaneRowWords = rowWords;
+        other.Planes.assign(volumeWords, 0);
+    }
+
+    if (!hasVolume) {
+        for (int x = 0; x < N; x++) {
+            packCells(world.Data[x], N, world.planeRow(N / 2, x));
+        }
+        return;
+    }
+
+    // A restored volume, its view saved with another --slice perhaps
+    showVolume(world);
+}
+
+void seedVolume(World& world, const SeedSettings& settings) {
+    const int words = packedWordCount(N);
+    world.PlaneCount = N;
+    world.PlaneRowWords = words;
+    world.Planes.assign(static_cast<size_t>(N) * N * words, 0);
+
+    const uint64_t key = seedKey(settings.seed);
+    const uint64_t threshold = seedThreshold(settings.density);
+    const uint64_t lastMask = lastWordMask(N);
+
+    // Slice z row x is row z * N + x of a tall 2D world, slices split between the sim workers
+    runOnSimWorkers(N, [&world, key, threshold, lastMask, words](const int firstSlice, const int lastSlice) {
+        for (int z = firstSlice; z < lastSlice; z++) {
+            for (int x = 0; x < N; x++) {
+                uint64_t* row = world.planeRow(z, x);
+                for (int i = 0; i < words; i++) {
+                    row[i] = seedWord(key, threshold, 64ull * i, static_cast<uint64_t>(z) * N + x)
+                        & (i == words - 1 ? lastMask : ~0ull);
+                }
+            }
+        }
+    });
+
+    showVolume(world);
+}
+
+atomic<int> volumeSlice {-1};
+
+void showVolume(World& world) {
+    const int words = world.PlaneRowWords;
+    const int slice = volumeSlice;
+
+    if (slice >= 0) {
+        for (int x = 0; x < N; x++) {
+            unpackCells(world.planeRow(min(slice, N - 1), x), N, world.Data[x]);
+        }
+        return;
+    }
+
+    vector<uint64_t> projection(words);
+    for (int x = 0; x < N; x++) {
+        fill(projection.begin(), projection.end(), 0);
+        for (int z = 0; z < N; z++) {
+            const uint64_t* row = world.planeRow(z, x);
+            for (int i = 0; i < words; i++) {
+                projection[i] |= row[i];
+            }
+        }
+        unpackCells(projection.data(), N, world.Data[x]);
+    }
+}
+
+void finishLife3DStep(const World& worldNow, World& worldNext) {
+    showVolume(worldNext);
+
+    if (trackCellAge) {
+        for (int x = 0; x < N; x++) {
+            for (int y = 0; y < N; y++) {
+                updateAge<true>(worldNow, worldNext, x, y);
+            }
+        }
+    }
+}
@@ -0,0 +1,37 @@
+﻿#pragma once
+
+#include "sim.h"
+#include "seed.h"
+
+#include <atomic>
+
+// 3D rules (see Life3DRule) on a torus of N x N x N cells held in
+// World::Planes, plane z being slice z with its rows bit-packed as in
+// bitpack.h. Neighbour sums are separable and bit-sliced, 64 cells at a
+// time: three cells along a row, then three of those sums across rows, then
+// three of those across slices. The sums of a slice are computed once and
+// serve the slice itself and both next to it. Workers step slabs of slices,
+// the bands of the usual worker model taken along z.
+constexpr int MAX_VOLUME_SIZE = 1024;  // 128 MiB of cells per world buffer
+
+void life3dKernels(const Life3DRule& rule, StepKernel& step, StepKernel& stepWithAge);
+
+// Sets up the volumes of the three world buffers. worlds[index] keeps a
+// volume restored from a checkpoint; when it has none, e.g. after loading
+// a 2D pattern, its cells become the middle slice.
+void prepareLife3DWorlds(int index);
+
+// Fills the volume of `world` with the noise of `settings`, its region
+// aside: the same volume for a seed whatever the thread count.
+void seedVolume(World& world, const SeedSettings& settings);
+
+// Data shows slice volumeSlice of the volume or, while it is negative, the
+// projection along z of the live cells. Read every generation.
+extern std::atomic<int> volumeSlice;
+
+// Writes the view of the volume of `world` to its Data.
+void showVolume(World& world);
+
+// Completes worldNext once every slab is stepped: its view, and its ages
+// while tracked.
+void finishLife3DStep(const World& worldNow, World& worldNext);
@@ -0,0 +1,155 @@
+﻿#include "ltl.h"
+#include "topology.h"
+
+#include <vector>
+
+using namespace std;
+
+LtlRule ltlRule;
+
+// Branch-free next state from the live count in the neighbourhood
+inline bool ltlNextState(const bool alive, const int count) {
+    const int low = alive ? ltlRule.survivalMin : ltlRule.birthMin;
+    const int high = alive ? ltlRule.survivalMax : ltlRule.birthMax;
+    return static_cast<unsigned>(count - low) <= static_cast<unsigned>(high - low);
+}
+
+// Rows are read padded with the halo, r + 1 cells deep, so padded column
+// y + r + 1 is world column y.
+template<bool TrackAge>
+void ltlMooreStep(const World& worldNow, World& worldNext, const int minX, const int maxX) {
+    const int r = ltlRule.range;
+    const int center = ltlRule.countCenter ? 0 : 1;
+    const int columns = N + 2 * r + 2;
+    bool* scratch = paddedRowScratch(2);
+
+    // Live cells of each padded column in rows x - r .. x + r
+    thread_local vector<int> columnSums;
+    columnSums.assign(columns, 0);
+
+    for (int dx = -r; dx <= r; dx++) {
+        const bool* row = paddedRow(worldNow, minX + dx, scratch);
+        for (int j = 0; j < columns; j++) {
+            columnSums[j] += row[j];
+        }
+    }
+
+    for (int x = minX; x < maxX; x++) {
+        if (x > minX) {
+            const bool* entering = paddedRow(worldNow, x + r, scratch);
+            const bool* leaving = paddedRow(worldNow, x - r - 1, scratch + columns);
+            for (int j = 0; j < columns; j++) {
+                columnSums[j] += entering[j] - leaving[j];
+            }
+        }
+
+        // Window of world columns y - r .. y + r, padded 1 + y .. 1 + y + 2r
+        int window = 0;
+        for (int j = 1; j <= 2 * r + 1; j++) {
+            window += columnSums[j];
+        }
+
+        const bool* now = worldNow.Data[x];
+        bool* next = worldNext.Data[x];
+        for (int y = 0; y < N; y++) {
+            next[y] = ltlNextState(now[y], window - center * now[y]);
+            window += columnSums[y + 2 * r + 2] - columnSums[y + 1];
+
+            updateAge<TrackAge>(worldNow, worldNext, x, y);
+        }
+    }
+}
+
+template<bool TrackAge>
+void ltlVonNeumannStep(const World& worldNow, World& worldNext, const int minX, const int maxX) {
+    const int r = ltlRule.range;
+    const int center = ltlRule.countCenter ? 0 : 1;
+
+    // Prefix sums along both diagonals over rows minX - r - 1 .. maxX + r and
+    // columns -r - 1 .. N + r, the halo included. Local row i is world row
+    // minX - r - 1 + i, local column j world column j - r - 1.
+    const int rows = maxX - minX + 2 * r + 2;
+    const int columns = N + 2 * r + 2;
+    thread_local vector<int> downRight;
+    thread_local vector<int> downLeft;
+    downRight.resize(static_cast<size_t>(rows) * columns);
+    downLeft.resize(downRight.size());
+
+    const auto at = [columns](vector<int>& sums, const int i, const int j) -> int& {
+        return sums[static_cast<size_t>(i) * columns + j];
+    };
+
+    bool* scratch = paddedRowScratch(1);
+
+    for (int i = 0; i < rows; i++) {
+        const bool* row = paddedRow(worldNow, minX - r - 1 + i, scratch);
+        for (int j = 0; j < columns; j++) {
+            const int cell = row[j];
+            at(downRight, i, j) = cell + (i > 0 && j > 0 ? at(downRight, i - 1, j - 1) : 0);
+            at(downLeft, i, j) = cell + (i > 0 && j < columns - 1 ? at(downLeft, i - 1, j + 1) : 0);
+        }
+    }
+
+    // Sum of the k + 1 cells from local (i, j) going down-right or down-left
+    const auto downRightRun = [&](const int i, const int j, const int k) {
+        return k < 0 ? 0 : at(downRight, i + k, j + k) - at(downRight, i - 1, j - 1);
+    };
+    const auto downLeftRun = [&](const int i, const int j, const int k) {
+        return k < 0 ? 0 : at(downLeft, i + k, j - k) - at(downLeft, i - 1, j + 1);
+    };
+
+    // Diamonds around the first row, a row of each diamond at a time from
+    // prefix sums along the rows
+    thread_local vector<int> diamonds;
+    thread_local vector<int> rowPrefix;
+    diamonds.assign(N, 0);
+    rowPrefix.resize(columns + 1);
+    const int firstRow = r + 1;
+
+    for (int dx = -r; dx <= r; dx++) {
+        const int half = r - (dx < 0 ? -dx : dx);
+        const bool* row = paddedRow(worldNow, minX + dx, scratch);
+
+        rowPrefix[0] = 0;
+        for (int j = 0; j < columns; j++) {
+            rowPrefix[j + 1] = rowPrefix[j] + row[j];
+        }
+        for (int y = 0; y < N; y++) {
+            const int j = y + r + 1;
+            diamonds[y] += rowPrefix[j + half + 1] - rowPrefix[j - half];
+        }
+    }
+
+    for (int x = minX; x < maxX; x++) {
+        const int i = firstRow + (x - minX);
+
+        if (x > minX) {
+            // Diamond of row x from that of row x - 1, centered at local row i - 1
+            const int c = i - 1;
+            for (int y = 0; y < N; y++) {
+                const int j = y + r + 1;
+                diamonds[y] += downRightRun(c + 1, j - r, r) + downLeftRun(c + 1, j + r, r - 1)
+                    - downLeftRun(c - r, j, r) - downRightRun(c - r + 1, j + 1, r - 1);
+            }
+        }
+
+        const bool* now = worldNow.Data[x];
+        bool* next = worldNext.Data[x];
+        for (int y = 0; y < N; y++) {
+            next[y] = ltlNextState(now[y], diamonds[y] - center * now[y]);
+            updateAge<TrackAge>(worldNow, worldNext, x, y);
+        }
+    }
+}
+
+void ltlKernels(const LtlRule& rule, StepKernel& step, StepKernel& stepWithAge) {
+    ltlRule = rule;
+
+    if (rule.shape == NeighbourhoodShape::Moore) {
+        step = ltlMooreStep<false>;
+        stepWithAge = ltlMooreStep<true>;
+    } else {
+        step = ltlVonNeumannStep<false>;
+        stepWithAge = ltlVonNeumannStep<true>;
+    }
+}
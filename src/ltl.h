@@ -0,0 +1,12 @@
+﻿#pragma once
+
+#include "sim.h"
+
+// Larger than Life (see LtlRule). Neighbourhood sums are kept as sliding
+// windows over the rows each worker steps, so a cell costs the same few
+// additions whatever the range:
+//  - Moore: per column sums over 2r + 1 rows, moved down a row at a time,
+//    then a window of 2r + 1 of them slid along the row;
+//  - von Neumann: moving the diamond down a row adds two diagonal edges below
+//    it and drops two above, each read from diagonal prefix sums.
+void ltlKernels(const LtlRule& rule, StepKernel& step, StepKernel& stepWithAge);
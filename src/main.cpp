@@ -1,273 +1,1006 @@
 ﻿#include "raylib.h"
 
-#include <bitset>
+#include "world.h"
+#include "sim.h"
+#include "recorder.h"
+#include "pacing.h"
+#include "stats.h"
+#include "snapshot.h"
+#include "rle.h"
+#include "checkpoint.h"
+#include "genlog.h"
+#include "outofcore.h"
+#include "dataset.h"
+#include "generations.h"
+#include "life3d.h"
+#include "rule_table.h"
+#include "seed.h"
+#include "stochastic.h"
+#include "shared_export.h"
+#include "stream.h"
+#include "image_export.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <fstream>
 #include <format>
+#include <iostream>
+#include <string>
+#include <string_view>
 #include <thread>
-#include <semaphore>
-#include <mutex>
+#include <vector>
 #include <atomic>
-#include <cmath>
 #include <chrono>
 
 using namespace std;
 
-constexpr int N = 2000;
-
-struct World {
-    bool Data[N][N];
+struct Options {
+    bool headless = false;
+    int generations = 0;        // 0 = unbounded
+    float durationSeconds = 0;  // 0 = unbounded
+    RecorderSettings recorder;
+    PacingSettings pacing;
+    string statsLogPath;
+    float statsLogInterval = 1.0f;
+    bool cellAge = false;
+    bool backward = false;
+    int volumeSlice = -1;       // 3D rules, -1 = projection
+    string loadRlePath;
+    bool loadAtGiven = false;
+    int loadLeft = 0;
+    int loadTop = 0;
+    string saveRlePath;
+    string saveImagePath;
+    int exportTileSize = DEFAULT_EXPORT_TILE_SIZE;
+    string restorePath;
+    string checkpointPath;
+    float checkpointInterval = 600.0f;
+    string logPath;
+    int logKeyframeInterval = 256;
+    string replayPath;
+    int replayFrom = 0;
+    SeedSettings seed;
+    StochasticSettings stochastic;  // seeded by --seed
+    OutOfCoreSettings outOfCore;
+    DatasetSettings dataset;
+    string sharedWorldName;
+    string serveHost = "127.0.0.1";
+    int servePort = 0;
+    string connectHost;
+    int connectPort = 0;
+    float streamRate = 0;
+    int size = DEFAULT_WORLD_SIZE;
+    int workers = DEFAULT_WORKER_COUNT;
+    string rule = DEFAULT_RULE;
+    bool ruleGiven = false;
+    vector<string> ruleFiles;
+    Color aliveColor = RED;
+    Color deadColor = DARKGREEN;
+    string batchPath;
+    string resultsPath;
 };
-World worlds[3];
 
-struct WorldIndices {
-    WorldIndices() = default;
-
-    explicit WorldIndices(const int store) {
-        constexpr int eightBitMask = 0xFF;
-        render = store & eightBitMask;
-        simOld = (store >> 8) & eightBitMask;
-        simNext = (store >> 16) & eightBitMask;
+// Splits a line into arguments at whitespace, keeping "quoted text" together
+// and dropping everything after a #.
+bool splitArguments(const string_view line, vector<string>& arguments) {
+    string current;
+    bool inArgument = false;
+    bool quoted = false;
+
+    for (const char c : line) {
+        if (quoted) {
+            if (c == '"') {
+                quoted = false;
+            } else {
+                current += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+            inArgument = true;
+        } else if (c == '#') {
+            break;
+        } else if (isspace(static_cast<unsigned char>(c))) {
+            if (inArgument) arguments.push_back(move(current));
+            current.clear();
+            inArgument = false;
+        } else {
+            current += c;
+            inArgument = true;
+        }
     }
 
-    int toInt() const {
-        return render | (simOld << 8) | (simNext << 16);
-    }
+    if (inArgument) arguments.push_back(move(current));
+    return !quoted;
+}
 
-    uint8_t render = 0;
-    uint8_t simOld = 0;
-    uint8_t simNext = 1;
-};
+// RRGGBB, optionally prefixed with #
+bool parseColor(string_view text, Color& color) {
+    if (text.starts_with('#')) text.remove_prefix(1);
+    if (text.size() != 6 || text.find_first_not_of("0123456789abcdefABCDEF") != string_view::npos) return false;
+
+    const unsigned long rgb = strtoul(string {text}.c_str(), nullptr, 16);
+    color = {
+        static_cast<unsigned char>(rgb >> 16),
+        static_cast<unsigned char>(rgb >> 8),
+        static_cast<unsigned char>(rgb),
+        255,
+    };
+    return true;
+}
+
+// "host:port" or just "port"
+bool parseHostPort(const string_view text, string& host, int& port) {
+    const size_t colon = text.rfind(':');
+    if (colon != string_view::npos) {
+        host = text.substr(0, colon);
+    }
 
-atomic<int> worldIndicesStore {WorldIndices{}.toInt()};
+    port = atoi(string {text.substr(colon == string_view::npos ? 0 : colon + 1)}.c_str());
+    return !host.empty() && 0 < port && port < 65536;
+}
 
-int moveWorldRenderIndex() {
-    int store = worldIndicesStore.load();
-    WorldIndices currentWorldIndices;
-    WorldIndices newWorldIndices;
+bool parseArguments(const vector<const char*>& args, Options& options, int depth = 0);
 
-    do {
-        currentWorldIndices = WorldIndices{store};
-        newWorldIndices = currentWorldIndices;
-        newWorldIndices.render = currentWorldIndices.simOld;
-    } while (!worldIndicesStore.compare_exchange_strong(store, newWorldIndices.toInt()));
+// Config files hold the same arguments as the command line, separated by
+// whitespace; "quotes" group words and # starts a comment.
+bool readArgumentFile(const string& path, vector<string>& arguments) {
+    ifstream file {path};
+    if (!file) {
+        cerr << format("Cannot read '{}'\n", path);
+        return false;
+    }
 
-    return currentWorldIndices.render;
+    for (string line; getline(file, line);) {
+        if (!splitArguments(line, arguments)) {
+            cerr << format("Unbalanced quotes in '{}': {}\n", path, line);
+            return false;
+        }
+    }
+    return true;
 }
 
-void moveWorldSimIndices() {
-    int store = worldIndicesStore.load();
-    WorldIndices currentWorldIndices;
-    WorldIndices newWorldIndices;
+bool parseArgumentFile(const string& path, Options& options, const int depth) {
+    constexpr int MAX_CONFIG_DEPTH = 8;
+    if (depth >= MAX_CONFIG_DEPTH) {
+        cerr << format("Config files nest too deep at '{}'\n", path);
+        return false;
+    }
+
+    vector<string> arguments;
+    if (!readArgumentFile(path, arguments)) return false;
 
-    do {
-        currentWorldIndices = WorldIndices{store};
-        newWorldIndices = currentWorldIndices;
-        newWorldIndices.simOld = newWorldIndices.simNext;
+    vector<const char*> args;
+    for (const string& argument : arguments) {
+        args.push_back(argument.c_str());
+    }
+    return parseArguments(args, options, depth + 1);
+}
 
-        if (newWorldIndices.render != 0 && newWorldIndices.simOld != 0) {
-            newWorldIndices.simNext = 0;
-        } else if (newWorldIndices.render != 1 && newWorldIndices.simOld != 1) {
-            newWorldIndices.simNext = 1;
+bool parseArguments(const vector<const char*>& args, Options& options, const int depth) {
+    const int argc = static_cast<int>(args.size());
+
+    for (int i = 0; i < argc; i++) {
+        const string_view arg = args[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--config" && hasValue) {
+            if (!parseArgumentFile(args[++i], options, depth)) return false;
+        } else if (arg == "--batch" && hasValue) {
+            options.batchPath = args[++i];
+        } else if (arg == "--results" && hasValue) {
+            options.resultsPath = args[++i];
+        } else if (arg == "--size" && hasValue) {
+            options.size = atoi(args[++i]);
+        } else if (arg == "--workers" && hasValue) {
+            options.workers = atoi(args[++i]);
+        } else if (arg == "--rule" && hasValue) {
+            options.rule = args[++i];
+            options.ruleGiven = true;
+        } else if (arg == "--rule-file" && hasValue) {
+            options.ruleFiles.push_back(args[++i]);
+        } else if (arg == "--alive-color" && hasValue && parseColor(args[i + 1], options.aliveColor)) {
+            ++i;
+        } else if (arg == "--dead-color" && hasValue && parseColor(args[i + 1], options.deadColor)) {
+            ++i;
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--generations" && hasValue) {
+            options.generations = atoi(args[++i]);
+        } else if (arg == "--duration" && hasValue) {
+            options.durationSeconds = static_cast<float>(atof(args[++i]));
+        } else if (arg == "--record" && hasValue && parseRecordFormat(args[i + 1], options.recorder.format)) {
+            ++i;
+        } else if (arg == "--record-path" && hasValue) {
+            options.recorder.path = args[++i];
+        } else if (arg == "--record-every" && hasValue) {
+            options.recorder.every = atoi(args[++i]);
+        } else if (arg == "--record-threads" && hasValue) {
+            options.recorder.encoderCount = atoi(args[++i]);
+        } else if (arg == "--record-queue" && hasValue) {
+            options.recorder.queueCapacity = atoi(args[++i]);
+        } else if (arg == "--record-policy" && hasValue
+                   && parseRecordOverflowPolicy(args[i + 1], options.recorder.overflowPolicy)) {
+            ++i;
+        } else if (arg == "--pacing" && hasValue && parsePacingMode(args[i + 1], options.pacing.mode)) {
+            ++i;
+        } else if (arg == "--target-fps" && hasValue) {
+            options.pacing.targetFps = atoi(args[++i]);
+        } else if (arg == "--gens-per-frame" && hasValue) {
+            options.pacing.gensPerFrame = atoi(args[++i]);
+        } else if (arg == "--stats-log" && hasValue) {
+            options.statsLogPath = args[++i];
+        } else if (arg == "--stats-interval" && hasValue) {
+            options.statsLogInterval = static_cast<float>(atof(args[++i]));
+        } else if (arg == "--cell-age") {
+            options.cellAge = true;
+        } else if (arg == "--backward") {
+            options.backward = true;
+        } else if (arg == "--slice" && hasValue) {
+            options.volumeSlice = atoi(args[++i]);
+        } else if (arg == "--load" && hasValue) {
+            options.loadRlePath = args[++i];
+        } else if (arg == "--load-at" && hasValue
+                   && sscanf(args[i + 1], "%d,%d", &options.loadLeft, &options.loadTop) == 2) {
+            options.loadAtGiven = true;
+            ++i;
+        } else if (arg == "--save-rle" && hasValue) {
+            options.saveRlePath = args[++i];
+        } else if (arg == "--save-image" && hasValue) {
+            options.saveImagePath = args[++i];
+        } else if (arg == "--export-tile" && hasValue) {
+            options.exportTileSize = atoi(args[++i]);
+        } else if (arg == "--restore" && hasValue) {
+            options.restorePath = args[++i];
+        } else if (arg == "--checkpoint" && hasValue) {
+            options.checkpointPath = args[++i];
+        } else if (arg == "--checkpoint-interval" && hasValue) {
+            options.checkpointInterval = static_cast<float>(atof(args[++i]));
+        } else if (arg == "--log" && hasValue) {
+            options.logPath = args[++i];
+        } else if (arg == "--log-keyframe" && hasValue) {
+            options.logKeyframeInterval = atoi(args[++i]);
+        } else if (arg == "--replay" && hasValue) {
+            options.replayPath = args[++i];
+        } else if (arg == "--replay-from" && hasValue) {
+            options.replayFrom = atoi(args[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            options.seed.seed = strtoull(args[++i], nullptr, 10);
+        } else if (arg == "--density" && hasValue) {
+            options.seed.density = static_cast<float>(atof(args[++i]));
+        } else if (arg == "--seed-region" && hasValue
+                   && sscanf(args[i + 1], "%d,%d,%d,%d", &options.seed.left, &options.seed.top,
+                             &options.seed.width, &options.seed.height) == 4) {
+            ++i;
+        } else if (arg == "--birth-probability" && hasValue) {
+            options.stochastic.birth = static_cast<float>(atof(args[++i]));
+        } else if (arg == "--survival-probability" && hasValue) {
+            options.stochastic.survival = static_cast<float>(atof(args[++i]));
+        } else if (arg == "--flip-probability" && hasValue) {
+            options.stochastic.flip = static_cast<float>(atof(args[++i]));
+        } else if (arg == "--shm" && hasValue) {
+            options.sharedWorldName = args[++i];
+        } else if (arg == "--serve" && hasValue && parseHostPort(args[i + 1], options.serveHost, options.servePort)) {
+            ++i;
+        } else if (arg == "--connect" && hasValue && parseHostPort(args[i + 1], options.connectHost, options.connectPort)) {
+            ++i;
+        } else if (arg == "--stream-rate" && hasValue) {
+            options.streamRate = static_cast<float>(atof(args[++i]));
+        } else if (arg == "--out-of-core" && hasValue) {
+            options.outOfCore.size = atoll(args[++i]);
+        } else if (arg == "--ooc-dir" && hasValue) {
+            options.outOfCore.directory = args[++i];
+        } else if (arg == "--ooc-band" && hasValue) {
+            options.outOfCore.bandRows = atoi(args[++i]);
+        } else if (arg == "--ooc-prefetch" && hasValue) {
+            options.outOfCore.prefetchBands = atoi(args[++i]);
+        } else if (arg == "--dataset" && hasValue) {
+            options.dataset.samples = atoll(args[++i]);
+        } else if (arg == "--dataset-dir" && hasValue) {
+            options.dataset.directory = args[++i];
+        } else if (arg == "--dataset-world" && hasValue) {
+            options.dataset.worldSize = atoi(args[++i]);
+        } else if (arg == "--dataset-tile" && hasValue) {
+            options.dataset.tileSize = atoi(args[++i]);
+        } else if (arg == "--dataset-frames" && hasValue) {
+            options.dataset.framesPerSample = atoi(args[++i]);
+        } else if (arg == "--dataset-stride" && hasValue) {
+            options.dataset.frameStride = atoi(args[++i]);
+        } else if (arg == "--dataset-warmup" && hasValue) {
+            options.dataset.warmup = atoi(args[++i]);
+        } else if (arg == "--dataset-shard" && hasValue) {
+            options.dataset.samplesPerShard = atoi(args[++i]);
+        } else if (arg == "--dataset-direct") {
+            options.dataset.directIo = true;
         } else {
-            newWorldIndices.simNext = 2;
+            cerr << format("Unknown or incomplete argument '{}'\n", arg);
+            return false;
         }
-    } while (!worldIndicesStore.compare_exchange_strong(store, newWorldIndices.toInt()));
+    }
+
+    return true;
 }
 
-void generateRandomNoise(World& world) {
-    for (int x = 0; x < N; x++) {
-        for (int y = 0; y < N; y++) {
-            world.Data[x][y] = (rand() % 100) < 40;
-        }
+// Margolus blocks tile the world, their offset phase wrapping around, and 3D
+// rules hold a --size cube that wraps on every axis. Also checked once a
+// pattern or checkpoint may have changed the rule.
+bool checkRuleGeometry(const Options& options, const Rule& rule) {
+    if (rule.family == RuleFamily::Margolus && (options.size % 2 != 0 || rule.topology != Topology::Torus)) {
+        cerr << "Margolus rules need an even --size and the torus\n";
+        return false;
     }
+    if (rule.family == RuleFamily::Life3D
+        && (options.size > MAX_VOLUME_SIZE || rule.topology != Topology::Torus || options.volumeSlice >= options.size)) {
+        cerr << format("3D rules need a --size of at most {}, the torus and a --slice within the size\n", MAX_VOLUME_SIZE);
+        return false;
+    }
+    return true;
 }
 
-int countAliveAround(const World& world, int x, int y) {
-    int count = 0;
-
-    constexpr int steps[][2] = {
-        { -1, -1 },
-        { -1,  0 },
-        { -1,  1 },
-        {  0, -1 },
-        // SKIP {  0,  0 },
-        {  0,  1 },
-        {  1, -1 },
-        {  1,  0 },
-        {  1,  1 },
-    };
+// Generation logs and streams carry the live cells only: all of a two-state
+// world, but not dying states, rule table states or a 3D volume. Also
+// checked once a pattern or checkpoint may have changed the rule.
+bool checkRuleOutputs(const Options& options, const Rule& rule) {
+    const bool multiState = rule.family == RuleFamily::Table || rule.family == RuleFamily::Life3D
+        || (rule.family == RuleFamily::LifeLike && rule.life.states > 2);
+    if (multiState && (!options.logPath.empty() || options.servePort > 0 || options.connectPort > 0)) {
+        cerr << format("--log, --serve and --connect only carry live cells, not the states of rule {}\n", formatRule(rule));
+        return false;
+    }
+    return true;
+}
 
-    for (const auto & [dx, dy] : steps) {
-        const int newX = x + dx;
-        const int newY = y + dy;
-        if (0 <= newX && newX < N && 0 <= newY && newY < N) {
-            count += world.Data[newX][newY];
-        } else {
-            count += world.Data[(N + newX) % N][(N + newY) % N];
-        }
+bool validateOptions(const Options& options) {
+    if (options.size < 8 || options.workers < 1) {
+        cerr << "--size must be at least 8 and --workers at least 1\n";
+        return false;
+    }
+
+    for (const string& path : options.ruleFiles) {
+        if (!loadRuleTable(path)) return false;
+    }
+
+    Rule rule;
+    if (!parseRule(options.rule, rule)) {
+        cerr << format("Rule {} is not a Life-like ({}), isotropic (B2-a/S12), Larger than Life, Margolus (MS,D...) or 3D (3D4555) rule, nor a rule table\n",
+            options.rule, DEFAULT_RULE);
+        return false;
+    }
+
+    if (rule.family == RuleFamily::LargerThanLife && 2 * rule.ltl.range + 1 > options.size) {
+        cerr << "The Larger than Life neighbourhood must fit in the world (2 * range + 1 <= --size)\n";
+        return false;
+    }
+
+    if (!checkRuleGeometry(options, rule) || !checkRuleOutputs(options, rule)) return false;
+
+    const StochasticSettings& stochastic = options.stochastic;
+    const auto probability = [](const float p) { return 0.f <= p && p <= 1.f; };
+    if (!probability(stochastic.birth) || !probability(stochastic.survival) || !probability(stochastic.flip)) {
+        cerr << "--birth-probability, --survival-probability and --flip-probability must be within 0..1\n";
+        return false;
+    }
+
+    if (stochastic.enabled() && rule.family != RuleFamily::LifeLike) {
+        cerr << "Stochastic rules need a Life-like or Generations rule\n";
+        return false;
+    }
+
+    // The bit-packed engines implement Conway's rule only
+    if ((options.outOfCore.size > 0 || options.dataset.samples > 0) && (rule != Rule {} || stochastic.enabled())) {
+        cerr << format("--out-of-core and --dataset only simulate {}\n", DEFAULT_RULE);
+        return false;
     }
 
-    return count;
+    if (!options.replayPath.empty() && !options.logPath.empty()) {
+        cerr << "--log cannot be combined with --replay\n";
+        return false;
+    }
+
+    if (options.connectPort > 0 && (!options.replayPath.empty() || !options.logPath.empty())) {
+        cerr << "--connect cannot be combined with --replay or --log\n";
+        return false;
+    }
+
+    if (options.outOfCore.size > 0 && options.generations <= 0 && options.durationSeconds <= 0) {
+        cerr << "--out-of-core requires --generations <count> and/or --duration <seconds>\n";
+        return false;
+    }
+
+    if (options.dataset.samples > 0 && (options.dataset.framesPerSample < 1 || options.dataset.frameStride < 1
+                                        || options.dataset.warmup < 0 || options.dataset.samplesPerShard < 1)) {
+        cerr << "--dataset-frames, --dataset-stride and --dataset-shard must be at least 1, --dataset-warmup at least 0\n";
+        return false;
+    }
+
+    if (options.headless && options.generations <= 0 && options.durationSeconds <= 0) {
+        cerr << "--headless requires --generations <count> and/or --duration <seconds>\n";
+        return false;
+    }
+
+    return true;
 }
 
-void simulateLifeStep(const int minX = 0, const int maxX = N) {
-    WorldIndices loadedWorldIndices {worldIndicesStore.load()};
+void printUsage() {
+    cerr << "Usage: gol [--config <file>] [--batch <runs file>] [--results <path>]\n"
+            "           [--size <cells>] [--workers <count>] [--rule <rule>] [--rule-file <file.rule>]\n"
+            "           [--alive-color <RRGGBB>] [--dead-color <RRGGBB>]\n"
+            "           [--headless] [--generations <count>] [--duration <seconds>]\n"
+            "           [--record png|y4m|raw] [--record-path <dir|file|->] [--record-every <k>]\n"
+            "           [--record-threads <count>] [--record-queue <frames>] [--record-policy block|drop]\n"
+            "           [--pacing free|sync|latest] [--target-fps <fps>] [--gens-per-frame <count>]\n"
+            "           [--stats-log <path>] [--stats-interval <seconds>]\n"
+            "           [--cell-age] [--backward] [--slice <z>] [--load <pattern.rle>] [--load-at <x>,<y>] [--save-rle <path>]\n"
+            "           [--save-image <path.png|path.pbm>] [--export-tile <cells>]\n"
+            "           [--restore <checkpoint>] [--checkpoint <path>] [--checkpoint-interval <seconds>]\n"
+            "           [--log <path>] [--log-keyframe <generations>] [--replay <log>] [--replay-from <generation>]\n"
+            "           [--seed <n>] [--density <0..1>] [--seed-region <x>,<y>,<w>,<h>] [--shm <name>]\n"
+            "           [--birth-probability <0..1>] [--survival-probability <0..1>] [--flip-probability <0..1>]\n"
+            "           [--serve [<host>:]<port>] [--connect <host>:<port>] [--stream-rate <generations/s>]\n"
+            "           [--out-of-core <size>] [--ooc-dir <dir>] [--ooc-band <rows>] [--ooc-prefetch <bands>]\n"
+            "           [--dataset <samples>] [--dataset-dir <dir>] [--dataset-world <cells>] [--dataset-tile <cells>]\n"
+            "           [--dataset-frames <count>] [--dataset-stride <generations>] [--dataset-warmup <generations>]\n"
+            "           [--dataset-shard <samples>] [--dataset-direct]\n";
+}
 
-    const World& worldNow = worlds[loadedWorldIndices.simOld];
-    World& worldNext = worlds[loadedWorldIndices.simNext];
+// Checkpoints and patterns name the rule they were made with, which is
+// simulated unless --rule chose one. Returns whether it is.
+bool applyFileRule(const Options& options, const string& fileRule, const string_view kind) {
+    if (fileRule.empty()) return false;
 
-    for (int x = minX; x < maxX; x++) {
-        for (int y = 0; y < N; y++) {
-            const int count = countAliveAround(worldNow, x, y);
+    Rule rule;
+    const bool known = parseRule(fileRule, rule);
+    if (known && rule == simRule()) return true;
 
-            if (worldNow.Data[x][y]) {
-                worldNext.Data[x][y] = 2 <= count && count <= 3;
-            } else {
-                worldNext.Data[x][y] = count == 3;
-            }
+    if (known && !options.ruleGiven) {
+        setSimRule(rule);
+        return true;
+    }
+
+    const string current = formatRule(simRule());
+    cerr << format("{} rule {} differs from {}, simulating {}\n", kind, fileRule, current, current);
+    return false;
+}
+
+bool initWorld(const Options& options, World& world) {
+    if (options.connectPort > 0) {
+        return startStreamClient(options.connectHost, options.connectPort, options.streamRate, !options.headless, world);
+    }
+
+    if (!options.replayPath.empty()) {
+        // Headless replays end with the log, windowed ones stay seekable
+        return startReplay(options.replayPath, options.replayFrom, !options.headless);
+    }
+
+    if (!options.restorePath.empty()) {
+        string rule;
+        if (!restoreCheckpoint(options.restorePath, world, rule)) return false;
+
+        // Planes and states are only meaningful to the engine of the checkpoint's rule
+        if (!applyFileRule(options, rule, "Checkpoint")) {
+            world.Planes.clear();
+            world.PlaneCount = 0;
+            world.States.clear();
+        }
+        simIndex = world.Generation;
+        return true;
+    }
+
+    if (options.loadRlePath.empty()) {
+        if (simRule().family == RuleFamily::Life3D) {
+            seedVolume(world, options.seed);
+        } else {
+            seedWorld(world, options.seed);
         }
+        return true;
+    }
+
+    RlePattern pattern;
+    int left = options.loadLeft;
+    int top = options.loadTop;
+
+    if (!options.loadAtGiven) {
+        // Centre the pattern
+        if (!readRleHeader(options.loadRlePath, pattern)) return false;
+        left = (N - pattern.width) / 2;
+        top = (N - pattern.height) / 2;
+    }
+
+    if (!importRle(options.loadRlePath, world, left, top, pattern)) return false;
+
+    applyFileRule(options, pattern.rule, "Pattern");
+
+    // Only rule tables and Generations rules simulate the states of multi-state patterns
+    const Rule& simulated = simRule();
+    if (simulated.family != RuleFamily::Table
+        && !(simulated.family == RuleFamily::LifeLike && simulated.life.states > 2)) {
+        world.States.clear();
     }
+    return true;
 }
 
+// Exports run on a snapshot in the background, so the sim keeps going.
+void exportRleInBackground(const string& path) {
+    runOnSnapshot([path](const World& world) {
+        const string fileName = path.empty() ? format("gol_{}.rle", world.Generation) : path;
+        if (exportRle(fileName, world, formatRule(simRule()))) {
+            cerr << format("Saved generation {} to '{}'\n", world.Generation, fileName);
+        }
+    });
+}
 
-int simIndex = 0;
-int frameIndex = 0;
+void exportImageInBackground(const string& path, const int tileSize) {
+    runOnSnapshot([path, tileSize](const World& world) {
+        const string fileName = path.empty() ? format("gol_{}.png", world.Generation) : path;
+        if (exportImage(fileName, world, tileSize)) {
+            cerr << format("Saved generation {} to '{}'\n", world.Generation, fileName);
+        }
+    });
+}
+
+// Stops whichever of the services around the sim are running, so their
+// threads are joined before the next run or exit.
+void stopRunServices() {
+    stopRecorder();
+    stopStatsLog();
+    stopCheckpointing();
+    stopGenerationLog();
+    stopSharedWorldExport();
+    stopStreamServer();
+    stopStreamClient();
+}
+
+void finishRun(const Options& options) {
+    stopRunServices();
+
+    if (!options.saveRlePath.empty()) {
+        exportRleInBackground(options.saveRlePath);
+    }
+    if (!options.saveImagePath.empty()) {
+        exportImageInBackground(options.saveImagePath, options.exportTileSize);
+    }
+    waitForSnapshotJobs();
+}
 
-chrono::time_point<chrono::high_resolution_clock> lastSimTime;
-atomic<float> simDuration = 0.f;
+bool bringUpRun(const Options& options) {
+    resizeWorlds(options.size);
+    simWorkerCount = options.workers;
 
-int GetSPS()
-{
-    constexpr int SPS_CAPTURE_FRAMES_COUNT = 30;        // 30 captures
-    constexpr float SPS_AVERAGE_TIME_SECONDS = 0.5f;    // 500 milliseconds
-    constexpr float SPS_STEP = SPS_AVERAGE_TIME_SECONDS / SPS_CAPTURE_FRAMES_COUNT;
+    StochasticSettings stochastic = options.stochastic;
+    stochastic.seed = options.seed.seed;
+    setStochasticSettings(stochastic);
 
-    static int index = 0;
-    static float history[SPS_CAPTURE_FRAMES_COUNT] = { 0 };
-    static float average = 0;
-    static chrono::time_point<chrono::high_resolution_clock> last;
+    Rule rule;
+    parseRule(options.rule, rule);
+    setSimRule(rule);
 
-    if (simDuration == 0) return 0;
+    if (!startSharedWorldExport(options.sharedWorldName)) {
+        return false;
+    }
 
-    const chrono::time_point<chrono::high_resolution_clock> now = chrono::high_resolution_clock::now();
+    WorldIndices loadedWorldIndices {worldIndicesStore.load()};
 
-    if (const chrono::duration<float> sinceLastCheck = now - last; sinceLastCheck.count() > SPS_STEP)
-    {
-        last = now;
-        index = (index + 1) % SPS_CAPTURE_FRAMES_COUNT;
-        average -= history[index];
-        history[index] = simDuration / SPS_CAPTURE_FRAMES_COUNT;
-        average += history[index];
+    // Init Sim World
+    if (!initWorld(options, worlds[loadedWorldIndices.simOld])) {
+        return false;
+    }
+    if (!checkRuleGeometry(options, simRule()) || !checkRuleOutputs(options, simRule())) return false;
+    if (options.backward && (simRule().family != RuleFamily::Margolus || !simRule().margolus.reversible())) {
+        cerr << "--backward needs a reversible rule, a Margolus rule whose table is a permutation\n";
+        return false;
     }
+    sharedWorldPublish(loadedWorldIndices.simOld, worlds[loadedWorldIndices.simOld].Generation);
+
+    // The limit counts generations simulated by this run, also after a restore
+    simGenerationLimit = options.generations > 0 ? simIndex + options.generations : 0;
+    trackCellAge = options.cellAge;
+    simBackward = options.backward;
+    volumeSlice = options.volumeSlice;
+
+    if (!startRecorder(options.recorder) || !startStatsLog(options.statsLogPath, options.statsLogInterval)
+        || !startGenerationLog(options.logPath, options.logKeyframeInterval, worlds[loadedWorldIndices.simOld], formatRule(simRule()))
+        || !startStreamServer(options.serveHost, options.servePort)) {
+        return false;
+    }
+    startCheckpointing(options.checkpointPath, options.checkpointInterval);
 
-    return static_cast<int>(roundf(1.0f / average));
+    return true;
 }
 
+// Sizes the worlds and brings up everything a run needs around the sim. On
+// failure the services already started are stopped again, exporting nothing.
+bool startRun(const Options& options) {
+    if (bringUpRun(options)) return true;
+
+    stopRunServices();
+    return false;
+}
 
-constexpr int WORKER_COUNT = 10;
+struct RunResult {
+    int generations = 0;
+    double seconds = 0;
+};
 
-atomic<bool> killSwitch {false};
-atomic<bool> workCanStart[WORKER_COUNT-1] {false};
-atomic<int> workFinishedCount {0};
+RunResult simulateHeadless(const Options& options) {
+    const int startGeneration = simIndex;
+    const chrono::time_point<chrono::steady_clock> start = chrono::steady_clock::now();
 
-void simulateLoopWorker(const int wi) {
-    const int minX = wi * N / WORKER_COUNT;
-    const int maxX = (wi + 1) * N / WORKER_COUNT;
+    thread simThread(simulateLoop);
 
-    while (!killSwitch) {
-        if (bool yes = true; workCanStart[wi].compare_exchange_strong(yes, false)) {
-            simulateLifeStep(minX, maxX);
-            ++workFinishedCount;
+    if (options.durationSeconds > 0) {
+        const auto deadline = start + chrono::duration<float>(options.durationSeconds);
+        while (!killSwitch && chrono::steady_clock::now() < deadline) {
+            this_thread::sleep_for(chrono::milliseconds(1));
         }
+        killSwitch = true;
     }
+
+    simThread.join();
+    finishRun(options);
+
+    const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return {simIndex - startGeneration, elapsed.count()};
 }
 
-void simulateLoop() {
-    thread workers[WORKER_COUNT-1];
-    for (int wi = 0; wi < WORKER_COUNT-1; wi++) {
-        workers[wi] = thread{simulateLoopWorker, wi};
+int runHeadless(const Options& options) {
+    const RunResult result = simulateHeadless(options);
+    const double cellsPerSecond = static_cast<double>(result.generations) * N * N / result.seconds;
+
+    // Keep stdout clean when the recorder streams frames through it
+    ostream& summary = recorderWritesToStdout(options.recorder) ? cerr : cout;
+    summary << format("generations {}\nseconds {:.3f}\ngenerations/s {:.1f}\ncells/s {:.3e}\n",
+        result.generations, result.seconds, result.generations / result.seconds, cellsPerSecond);
+    summary << formatPhaseTable();
+
+    return 0;
+}
+
+int64_t countPopulation(const World& world) {
+    const bool* cells = world.Data.cells;
+    const size_t cellCount = static_cast<size_t>(N) * N;
+    return count(cells, cells + cellCount, true);
+}
+
+// Features that live for the whole process can't be part of a batch run
+bool batchCompatible(const Options& options) {
+    if (!options.sharedWorldName.empty() || options.servePort > 0 || options.connectPort > 0
+        || options.outOfCore.size > 0 || options.dataset.samples > 0 || !options.batchPath.empty()) {
+        cerr << "--shm, --serve, --connect, --out-of-core, --dataset and --batch cannot be used in batch runs\n";
+        return false;
     }
+    return true;
+}
 
-    constexpr int last_wi = WORKER_COUNT-1;
-    constexpr int minX = last_wi * N / WORKER_COUNT;
-    constexpr int maxX = (last_wi + 1) * N / WORKER_COUNT;
+// Runs every line of the batch file as a headless run on top of `options`,
+// one after another on the same workers and world buffers, and appends one
+// JSON results record per run.
+int runBatch(const Options& options) {
+    ifstream runs {options.batchPath};
+    if (!runs) {
+        cerr << format("Cannot read batch file '{}'\n", options.batchPath);
+        return 1;
+    }
 
-    while (!killSwitch) {
-        for (auto& wi : workCanStart) {
-            wi.store(true);
+    ofstream resultsFile;
+    if (!options.resultsPath.empty()) {
+        resultsFile.open(options.resultsPath, ios::app);
+        if (!resultsFile) {
+            cerr << format("Cannot open results file '{}'\n", options.resultsPath);
+            return 1;
         }
+    }
+    ostream& results = options.resultsPath.empty() ? cout : resultsFile;
+
+    Options base = options;
+    base.batchPath.clear();
+    base.headless = true;
+    if (!batchCompatible(base)) return 1;
+
+    int runNumber = 0;
+    int failedCount = 0;
+    int lineNumber = 0;
 
-        simulateLifeStep(minX, maxX);
+    for (string line; getline(runs, line);) {
+        ++lineNumber;
+
+        vector<string> arguments;
+        const bool split = splitArguments(line, arguments);
+        if (split && arguments.empty()) continue;
+
+        vector<const char*> args;
+        for (const string& argument : arguments) {
+            args.push_back(argument.c_str());
+        }
 
-        while (!killSwitch && workFinishedCount < WORKER_COUNT-1) { }
-        workFinishedCount = 0;
+        Options run = base;
+        RunResult result;
+        string status = "ok";
 
+        if (!split || !parseArguments(args, run) || !validateOptions(run) || !batchCompatible(run)) {
+            status = "invalid";
+        } else {
+            resetSimulation();
+
+            if (startRun(run)) {
+                result = simulateHeadless(run);
+            } else {
+                status = "failed";
+            }
+        }
 
-        const chrono::time_point<chrono::high_resolution_clock> now = chrono::high_resolution_clock::now();
-        chrono::duration<float> durInSeconds {now - lastSimTime};
-        simDuration = durInSeconds.count();
-        lastSimTime = now;
+        ++runNumber;
+        if (status != "ok") {
+            ++failedCount;
+            results << format("{{\"run\":{},\"line\":{},\"status\":\"{}\"}}\n", runNumber, lineNumber, status);
+            results.flush();
+            continue;
+        }
 
-        moveWorldSimIndices();
+        const WorldIndices finalWorldIndices {worldIndicesStore.load()};
+        const double seconds = max(result.seconds, 1e-9);
 
-        ++simIndex;
+        results << format("{{\"run\":{},\"line\":{},\"status\":\"ok\",\"size\":{},\"workers\":{},\"rule\":\"{}\","
+                          "\"seed\":{},\"density\":{},\"generations\":{},\"seconds\":{:.6f},"
+                          "\"generations_per_second\":{:.3f},\"cells_per_second\":{:.6e},\"population\":{}}}\n",
+            runNumber, lineNumber, N, simWorkerCount, formatRule(simRule()), run.seed.seed, run.seed.density,
+            result.generations, result.seconds, result.generations / seconds,
+            static_cast<double>(result.generations) * N * N / seconds, countPopulation(worlds[finalWorldIndices.simOld]));
+        results.flush();
     }
 
-    for (auto& worker : workers) {
-        worker.join();
+    cerr << format("Batch finished: {} runs, {} failed\n", runNumber, failedCount);
+    return failedCount == 0 ? 0 : 1;
+}
+
+int frameIndex = 0;
+
+enum class DisplayMode {
+    Cells,
+    Age,
+};
+
+// Heat palette for World::Age: cells that just changed are bright, long
+// unchanged ones fade to dark blue. Age is log-scaled to spread young ages.
+void buildAgePalette(Color (&palette)[256]) {
+    constexpr Color stops[] = {
+        {255, 255, 210, 255},
+        {255, 190,  40, 255},
+        {220,  50,  30, 255},
+        {110,  20, 110, 255},
+        { 10,  10,  40, 255},
+    };
+    constexpr int lastStop = sizeof(stops) / sizeof(stops[0]) - 1;
+
+    for (int age = 0; age < 256; age++) {
+        const float t = log1pf(static_cast<float>(age)) / log1pf(255.f) * lastStop;
+        const int stop = min(static_cast<int>(t), lastStop - 1);
+        const float f = t - static_cast<float>(stop);
+        const Color& a = stops[stop];
+        const Color& b = stops[stop + 1];
+
+        palette[age] = {
+            static_cast<unsigned char>(a.r + (b.r - a.r) * f),
+            static_cast<unsigned char>(a.g + (b.g - a.g) * f),
+            static_cast<unsigned char>(a.b + (b.b - a.b) * f),
+            255,
+        };
     }
 }
 
-int main() {
-    WorldIndices loadedWorldIndices {worldIndicesStore.load()};
+// Generations rules: dead and live cells in their usual colours, dying
+// states fading from the live towards the dead colour. Rule tables use the
+// same ramp over their states, or the colours of their @COLORS section.
+void buildStatePalette(const Options& options, const Rule& rule, Color (&palette)[MAX_RULE_STATES]) {
+    const Color& a = options.aliveColor;
+    const Color& b = options.deadColor;
+    const int states = rule.family == RuleFamily::Table ? rule.table->states : rule.life.states;
+
+    palette[0] = b;
+    palette[1] = a;
+    for (int state = 2; state < states; state++) {
+        const float f = static_cast<float>(state - 1) / static_cast<float>(states - 1);
+        palette[state] = {
+            static_cast<unsigned char>(a.r + (b.r - a.r) * f),
+            static_cast<unsigned char>(a.g + (b.g - a.g) * f),
+            static_cast<unsigned char>(a.b + (b.b - a.b) * f),
+            255,
+        };
+    }
 
-    // Init Sim World
-    generateRandomNoise(worlds[loadedWorldIndices.simOld]);
+    if (rule.family == RuleFamily::Table) {
+        for (int state = 0; state < states; state++) {
+            const RuleTable::StateColor& color = rule.table->colors[state];
+            if (color.given) palette[state] = {color.r, color.g, color.b, 255};
+        }
+    }
+}
+
+void traceLogToStderr(const int logLevel, const char* text, va_list args) {
+    (void)logLevel;
+    vfprintf(stderr, text, args);
+    fputc('\n', stderr);
+}
+
+int runWindowed(const Options& options) {
+    if (recorderWritesToStdout(options.recorder)) {
+        SetTraceLogCallback(traceLogToStderr);
+    }
 
     InitWindow(N, N, "Game Of Life");
-    //SetTargetFPS(64);
+
+    FramePacer pacer {options.pacing};
+    LatencyTracker latency;
+
+    if (options.pacing.mode == PacingMode::Sync) {
+        SetTargetFPS(options.pacing.targetFps);
+    }
 
     thread simThread(simulateLoop);
 
     const Image img = GenImageColor(N, N, BLACK);
     const Texture2D tex = LoadTextureFromImage(img);
 
+    bool showPhaseOverlay = false;
+
+    DisplayMode displayMode = options.cellAge ? DisplayMode::Age : DisplayMode::Cells;
+    Color agePalette[256];
+    buildAgePalette(agePalette);
+
+    Color statePalette[MAX_RULE_STATES];
+    buildStatePalette(options, simRule(), statePalette);
+    vector<uint8_t> rowStates(N);
+
     while (!WindowShouldClose()) {
+        ScopedPhase framePhase {Phase::RenderFrame};
+        ScopedPhase phase {Phase::RenderWait};
+
+        pacer.waitForHandover();
+
+        phase.restart(Phase::RenderConvert);
+
         const uint8_t currentRenderIndex = moveWorldRenderIndex();
 
-        const auto Data = worlds[currentRenderIndex].Data;
+        const World& world = worlds[currentRenderIndex];
+
+        if (displayMode == DisplayMode::Age) {
+            const auto Age = world.Age;
+
+            for (int x = 0; x < N; x++) {
+                for (int y = 0; y < N; y++) {
+                    static_cast<Color*>(img.data)[x*N + y] = agePalette[Age[x][y]];
+                }
+            }
+        } else if (!world.States.empty()) {
+            for (int x = 0; x < N; x++) {
+                const uint8_t* states = world.stateRow(x);
+                for (int y = 0; y < N; y++) {
+                    static_cast<Color*>(img.data)[x*N + y] = statePalette[states[y]];
+                }
+            }
+        } else if (world.PlaneCount > 1 && simRule().family == RuleFamily::LifeLike) {
+            // Only Generations worlds carry dying states, 3D ones their volume
+            for (int x = 0; x < N; x++) {
+                unpackGenerationsStates(world, x, rowStates.data());
+                for (int y = 0; y < N; y++) {
+                    static_cast<Color*>(img.data)[x*N + y] = statePalette[rowStates[y]];
+                }
+            }
+        } else {
+            const auto Data = world.Data;
 
-        for (int x = 0; x < N; x++) {
-            for (int y = 0; y < N; y++) {
-                static_cast<Color*>(img.data)[x*N + y] = Data[x][y] ? RED : DARKGREEN;
+            for (int x = 0; x < N; x++) {
+                for (int y = 0; y < N; y++) {
+                    static_cast<Color*>(img.data)[x*N + y] = Data[x][y] ? options.aliveColor : options.deadColor;
+                }
             }
         }
 
+        phase.restart(Phase::RenderUpload);
+
         BeginDrawing();
 
         UpdateTexture(tex, img.data);
 
+        phase.restart(Phase::RenderDraw);
+
         DrawTexture(tex, 0, 0, WHITE);
 
         const int localSimIndex = simIndex;
 
-        string simDetails = format("FPS {}\tFID {}\nSPS {}\tSID {} (d {})",
-            GetFPS(), frameIndex, GetSPS(), localSimIndex, localSimIndex-frameIndex);
+        string simDetails = format("FPS {}\tFID {}\nSPS {}\tSID {} (d {})\nLAT {:.1f} ms (max {:.1f}) {}",
+            GetFPS(), frameIndex, GetSPS(), localSimIndex, localSimIndex-frameIndex,
+            latency.averageMs, latency.maxMs, pacingModeName(options.pacing.mode));
         DrawText(simDetails.c_str(), 0, 0, 30, BLACK);
 
+        if (IsKeyPressed(KEY_H)) {
+            trackCellAge = true;
+            displayMode = displayMode == DisplayMode::Age ? DisplayMode::Cells : DisplayMode::Age;
+        }
+        if (IsKeyPressed(KEY_B)) {
+            simBackward = !simBackward;
+        }
+        if (simRule().family == RuleFamily::Life3D) {
+            // The projection, or a slice moved through the volume
+            if (IsKeyPressed(KEY_M)) volumeSlice = volumeSlice < 0 ? N / 2 : -1;
+            if (IsKeyPressed(KEY_PAGE_UP) && volumeSlice >= 0) volumeSlice = min(N - 1, volumeSlice + 1);
+            if (IsKeyPressed(KEY_PAGE_DOWN) && volumeSlice >= 0) volumeSlice = max(0, volumeSlice - 1);
+        }
+        if (IsKeyPressed(KEY_E)) {
+            exportRleInBackground(options.saveRlePath);
+        }
+        if (IsKeyPressed(KEY_P)) {
+            exportImageInBackground(options.saveImagePath, options.exportTileSize);
+        }
+        if (!options.replayPath.empty()) {
+            constexpr int REPLAY_SEEK_STEP = 100;
+            if (IsKeyPressed(KEY_RIGHT)) requestReplaySeek(simIndex + REPLAY_SEEK_STEP);
+            if (IsKeyPressed(KEY_LEFT)) requestReplaySeek(simIndex - REPLAY_SEEK_STEP);
+            if (IsKeyPressed(KEY_HOME)) requestReplaySeek(0);
+        }
+        if (IsKeyPressed(KEY_F3)) {
+            showPhaseOverlay = !showPhaseOverlay;
+        }
+        if (showPhaseOverlay) {
+            const string phaseTable = formatPhaseTable();
+            DrawRectangle(0, 100, 560, 30 + 25 * PHASE_COUNT, Fade(WHITE, 0.8f));
+            DrawText(phaseTable.c_str(), 10, 110, 20, BLACK);
+        }
+
         EndDrawing();
 
+        const chrono::steady_clock::time_point presentedAt = chrono::steady_clock::now();
+        latency.add(world, presentedAt);
+        pacer.framePresented(presentedAt);
+
         ++frameIndex;
     }
 
     killSwitch = true;
+    releaseSimGenerations(1);
 
     UnloadTexture(tex);
     UnloadImage(img);
 
     simThread.join();
+    finishRun(options);
 
     CloseWindow();
 
     return 0;
 }
+
+int main(const int argc, char** argv) {
+    Options options;
+    if (!parseArguments({argv + 1, argv + argc}, options) || !validateOptions(options)) {
+        printUsage();
+        return 1;
+    }
+
+    // The out-of-core engine owns its world on disk and runs without a window
+    if (options.outOfCore.size > 0) {
+        options.outOfCore.generations = options.generations;
+        options.outOfCore.durationSeconds = options.durationSeconds;
+        options.outOfCore.seed = options.seed;
+        return runOutOfCore(options.outOfCore);
+    }
+
+    // So does the dataset writer, with a world per sample
+    if (options.dataset.samples > 0) {
+        options.dataset.seed = options.seed;
+        return runDatasetWriter(options.dataset);
+    }
+
+    int status = 1;
+    if (!options.batchPath.empty()) {
+        status = runBatch(options);
+    } else if (startRun(options)) {
+        status = options.headless ? runHeadless(options) : runWindowed(options);
+    }
+
+    stopSimWorkers();
+    return status;
+}
@@ -0,0 +1,201 @@
+﻿#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+using namespace std;
+
+#ifdef _WIN32
+
+bool MappedFile::map(const string& path) {
+    unmap();
+
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        fileHandle = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+        unmap();
+        return false;
+    }
+    size = static_cast<size_t>(fileSize.QuadPart);
+
+    return mapOpenFile(false);
+}
+
+bool MappedFile::create(const string& path, const size_t fileSize) {
+    unmap();
+
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        fileHandle = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER newSize;
+    newSize.QuadPart = static_cast<LONGLONG>(fileSize);
+    if (fileSize == 0 || !SetFilePointerEx(fileHandle, newSize, nullptr, FILE_BEGIN) || !SetEndOfFile(fileHandle)) {
+        unmap();
+        return false;
+    }
+    size = fileSize;
+
+    return mapOpenFile(true);
+}
+
+bool MappedFile::mapOpenFile(const bool writable) {
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle == nullptr) {
+        unmap();
+        return false;
+    }
+
+    data = static_cast<uint8_t*>(MapViewOfFile(mappingHandle, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+    if (data == nullptr) {
+        unmap();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::unmap() {
+    if (data != nullptr) UnmapViewOfFile(data);
+    if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+    if (fileHandle != nullptr) CloseHandle(fileHandle);
+
+    data = nullptr;
+    size = 0;
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+}
+
+void MappedFile::willNeed(const size_t offset, const size_t length) const {
+    if (offset >= size) return;
+
+    WIN32_MEMORY_RANGE_ENTRY range {data + offset, min(length, size - offset)};
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+void MappedFile::dontNeed(const size_t offset, const size_t length) const {
+    if (offset >= size) return;
+
+    // Unlocking pages that are not locked removes them from the working set
+    VirtualUnlock(data + offset, min(length, size - offset));
+}
+
+void MappedFile::flushAsync(const size_t offset, const size_t length) const {
+    if (offset >= size) return;
+
+    // Queues the dirty pages for writing without waiting for the disk
+    FlushViewOfFile(data + offset, min(length, size - offset));
+}
+
+#else
+
+bool MappedFile::map(const string& path) {
+    unmap();
+
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat fileStat {};
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        unmap();
+        return false;
+    }
+    size = static_cast<size_t>(fileStat.st_size);
+
+    if (!mapOpenFile(false)) return false;
+
+    madvise(data, size, MADV_SEQUENTIAL);
+    return true;
+}
+
+bool MappedFile::create(const string& path, const size_t fileSize) {
+    unmap();
+
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+
+    if (fileSize == 0 || ftruncate(fd, static_cast<off_t>(fileSize)) != 0) {
+        unmap();
+        return false;
+    }
+    size = fileSize;
+
+    return mapOpenFile(true);
+}
+
+bool MappedFile::mapOpenFile(const bool writable) {
+    void* mapping = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+        writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+
+    // The mapping keeps its own reference to the file
+    close(fd);
+    fd = -1;
+
+    if (mapping == MAP_FAILED) {
+        size = 0;
+        return false;
+    }
+
+    data = static_cast<uint8_t*>(mapping);
+    return true;
+}
+
+void MappedFile::unmap() {
+    if (data != nullptr) munmap(data, size);
+    if (fd >= 0) close(fd);
+
+    data = nullptr;
+    size = 0;
+    fd = -1;
+}
+
+// madvise wants page aligned addresses, widen the range to whole pages
+void adviseRange(uint8_t* data, const size_t size, const size_t offset, const size_t length, const int advice) {
+    if (offset >= size) return;
+
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t begin = offset / pageSize * pageSize;
+    const size_t end = min(size, offset + length);
+
+    madvise(data + begin, end - begin, advice);
+}
+
+void MappedFile::willNeed(const size_t offset, const size_t length) const {
+    adviseRange(data, size, offset, length, MADV_WILLNEED);
+}
+
+void MappedFile::dontNeed(const size_t offset, const size_t length) const {
+    // For shared file mappings dirty pages stay in the page cache and are still written back
+    adviseRange(data, size, offset, length, MADV_DONTNEED);
+}
+
+void MappedFile::flushAsync(const size_t offset, const size_t length) const {
+    if (offset >= size) return;
+
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t begin = offset / pageSize * pageSize;
+    const size_t end = min(size, offset + length);
+
+    msync(data + begin, end - begin, MS_ASYNC);
+}
+
+#endif
@@ -0,0 +1,40 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Memory mapping of a whole file (mmap / MapViewOfFile).
+struct MappedFile {
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { unmap(); }
+
+    // Maps an existing file read-only.
+    bool map(const std::string& path);
+
+    // Creates or resizes the file to `fileSize` bytes and maps it read-write;
+    // writes go straight to the page cache and reach the file on flush/unmap.
+    bool create(const std::string& path, size_t fileSize);
+
+    void unmap();
+
+    // Paging hints for a byte range; all of them are advisory and cheap.
+    void willNeed(size_t offset, size_t length) const;   // start reading ahead
+    void dontNeed(size_t offset, size_t length) const;   // drop from this process' working set
+    void flushAsync(size_t offset, size_t length) const; // start writing dirty pages back
+
+    uint8_t* data = nullptr;
+    size_t size = 0;
+
+private:
+    bool mapOpenFile(bool writable);
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
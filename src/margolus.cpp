@@ -0,0 +1,138 @@
+﻿#include "margolus.h"
+#include "bitlife.h"
+#include "bitpack.h"
+
+#include <array>
+
+using namespace std;
+
+constexpr int BLOCK_CELLS = 4;  // upper left, upper right, lower left, lower right
+
+// All ones where a block pattern sets a cell of the next block, by direction
+// (forward, backward), pattern and cell
+uint64_t blockOutputs[2][16][BLOCK_CELLS];
+
+// Bits of the left column of the blocks on even generations, odd ones use
+// the other bits; the right column is the bit above
+constexpr uint64_t EVEN_COLUMNS = 0x5555555555555555ull;
+
+struct BlockRow {
+    uint64_t cells[BLOCK_CELLS];
+};
+
+// Next cells of the blocks whose left column is set in `left`, each cell at
+// the bit of that column
+inline BlockRow nextBlocks(const uint64_t (&outputs)[16][BLOCK_CELLS], const BlockRow& blocks, const uint64_t left) {
+    const uint64_t upperLeft = blocks.cells[0];
+    const uint64_t upperRight = blocks.cells[1];
+    const uint64_t lowerLeft = blocks.cells[2];
+    const uint64_t lowerRight = blocks.cells[3];
+
+    // Blocks matching each pattern of their upper and of their lower cells
+    const uint64_t upper[4] = {~upperLeft & ~upperRight, upperLeft & ~upperRight, ~upperLeft & upperRight, upperLeft & upperRight};
+    const uint64_t lower[4] = {~lowerLeft & ~lowerRight, lowerLeft & ~lowerRight, ~lowerLeft & lowerRight, lowerLeft & lowerRight};
+
+    BlockRow next {};
+    for (int pattern = 0; pattern < 16; pattern++) {
+        const uint64_t matching = upper[pattern & 3] & lower[pattern >> 2] & left;
+        for (int cell = 0; cell < BLOCK_CELLS; cell++) {
+            next.cells[cell] |= matching & outputs[pattern][cell];
+        }
+    }
+    return next;
+}
+
+template<bool Backward, bool TrackAge>
+void margolusStep(const World& worldNow, World& worldNext, const int minX, const int maxX) {
+    const int words = worldNow.PlaneRowWords;
+    const int phase = (worldNow.Generation + static_cast<int>(Backward)) & 1;
+    const uint64_t columns = phase == 0 ? EVEN_COLUMNS : ~EVEN_COLUMNS;
+    const uint64_t lastMask = lastWordMask(N);
+    const int lastColumnBit = (N - 1) % 64;
+    const auto& outputs = blockOutputs[Backward];
+
+    // Each worker takes the rows of blocks whose upper row is in its band;
+    // on odd generations the last one wraps around to row 0
+    for (int x = minX + ((minX & 1) != phase); x < maxX; x += 2) {
+        const int rows[2] = {x, x + 1 == N ? 0 : x + 1};
+        const EdgedRow upper {worldNow.planeRow(0, rows[0]), false, (worldNow.planeRow(0, rows[0])[0] & 1) != 0};
+        const EdgedRow lower {worldNow.planeRow(0, rows[1]), false, (worldNow.planeRow(0, rows[1])[0] & 1) != 0};
+        uint64_t* nextRows[2] = {worldNext.planeRow(0, rows[0]), worldNext.planeRow(0, rows[1])};
+
+        uint64_t carry[2] = {0, 0};
+        for (int i = 0; i < words; i++) {
+            const bool last = i == words - 1;
+            const uint64_t left = columns & (last ? lastMask : ~0ull);
+
+            // On odd generations the last block's right column is column 0
+            const BlockRow next = nextBlocks(outputs, {
+                upper.cells[i], eastOf(upper, i, words, N),
+                lower.cells[i], eastOf(lower, i, words, N),
+            }, left);
+
+            for (int r = 0; r < 2; r++) {
+                const uint64_t nextLeft = next.cells[2 * r];
+                const uint64_t nextRight = next.cells[2 * r + 1];
+                nextRows[r][i] = nextLeft | (nextRight << 1) | carry[r];
+                carry[r] = nextRight >> 63;
+
+                if (last) {
+                    nextRows[r][i] &= lastMask;
+                    nextRows[r][0] |= nextRight >> lastColumnBit & 1;
+                }
+            }
+        }
+
+        for (const int row : rows) {
+            unpackCells(worldNext.planeRow(0, row), N, worldNext.Data[row]);
+
+            if constexpr (TrackAge) {
+                for (int y = 0; y < N; y++) {
+                    updateAge<true>(worldNow, worldNext, row, y);
+                }
+            }
+        }
+    }
+}
+
+void setBlockOutputs(const int direction, const array<uint8_t, 16>& next) {
+    for (int pattern = 0; pattern < 16; pattern++) {
+        for (int cell = 0; cell < BLOCK_CELLS; cell++) {
+            blockOutputs[direction][pattern][cell] = next[pattern] >> cell & 1 ? ~0ull : 0;
+        }
+    }
+}
+
+void margolusKernels(const MargolusRule& rule, StepKernel& step, StepKernel& stepWithAge,
+                     StepKernel& stepBackward, StepKernel& stepBackwardWithAge) {
+    setBlockOutputs(0, rule.next);
+    step = margolusStep<false, false>;
+    stepWithAge = margolusStep<false, true>;
+
+    stepBackward = nullptr;
+    stepBackwardWithAge = nullptr;
+    if (!rule.reversible()) return;
+
+    array<uint8_t, 16> inverse {};
+    for (int pattern = 0; pattern < 16; pattern++) {
+        inverse[rule.next[pattern]] = static_cast<uint8_t>(pattern);
+    }
+    setBlockOutputs(1, inverse);
+    stepBackward = margolusStep<true, false>;
+    stepBackwardWithAge = margolusStep<true, true>;
+}
+
+void prepareMargolusWorlds(const int index) {
+    const int rowWords = packedWordCount(N);
+
+    for (World& world : worlds) {
+        world.PlaneCount = 1;
+        world.PlaneRowWords = rowWords;
+        world.Planes.assign(static_cast<size_t>(N) * rowWords, 0);
+    }
+
+    World& world = worlds[index];
+    for (int x = 0; x < N; x++) {
+        packCells(world.Data[x], N, world.planeRow(0, x));
+    }
+}
@@ -0,0 +1,17 @@
+﻿#pragma once
+
+#include "sim.h"
+
+// Margolus block rules (see MargolusRule) on bit-packed rows in plane 0 of
+// World::Planes. Two rows hold a row of blocks: with the left cells of the
+// blocks masked to every other bit, the four cells of 32 blocks are four
+// words, and each next cell is the OR of the block patterns setting it.
+//
+// The phase alternates with World::Generation. Stepping backward applies the
+// inverse table with the other phase, so a backward step undoes the step
+// before it whichever generation it is, at the cost of a forward one.
+void margolusKernels(const MargolusRule& rule, StepKernel& step, StepKernel& stepWithAge,
+                     StepKernel& stepBackward, StepKernel& stepBackwardWithAge);
+
+// Sizes the planes of the three world buffers and packs worlds[index].
+void prepareMargolusWorlds(int index);
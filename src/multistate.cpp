@@ -0,0 +1,274 @@
+﻿#include "multistate.h"
+#include "topology.h"
+
+#include <algorithm>
+#include <bit>
+#include <vector>
+
+using namespace std;
+
+constexpr size_t MAX_LOOKUP_ENTRIES = size_t {1} << 22;
+
+const RuleTable* stateTable = nullptr;
+
+// Next state by lookup index, for the count and neighbourhood kernels
+vector<uint8_t> stateLookup;
+
+// Count kernel: index weight of a neighbour by its state, and of the cell's
+// own state (the number of distinct neighbour counts)
+uint32_t neighbourWeights[MAX_RULE_STATES];
+uint32_t centerWeight = 0;
+
+// Neighbourhood kernel: bits of a cell's state in the index
+int stateBits = 0;
+
+template<bool TrackAge>
+void updateStateAge(const World& worldNow, World& worldNext, const int x, const int y) {
+    if constexpr (TrackAge) {
+        const uint8_t age = worldNow.Age[x][y];
+        const bool unchanged = worldNext.stateRow(x)[y] == worldNow.stateRow(x)[y];
+        worldNext.Age[x][y] = static_cast<uint8_t>((age + (age != 0xFF)) * unchanged);
+    }
+}
+
+template<bool TrackAge>
+void writeState(const World& worldNow, World& worldNext, const int x, const int y, const uint8_t state) {
+    worldNext.stateRow(x)[y] = state;
+    worldNext.Data[x][y] = state != 0;
+    updateStateAge<TrackAge>(worldNow, worldNext, x, y);
+}
+
+template<NeighbourhoodShape Shape, bool TrackAge>
+void tableCountStep(const World& worldNow, World& worldNext, const int minX, const int maxX) {
+    // Weights of the padded columns, Moore only
+    thread_local vector<uint32_t> columnWeights;
+    columnWeights.resize(N + 2);
+
+    PaddedRows<uint8_t> rows;
+    rows.start(worldNow, minX);
+
+    for (int x = minX; x < maxX; x++) {
+        if (x > minX) rows.next(worldNow);
+
+        const uint8_t* above = rows.above;
+        const uint8_t* row = rows.row;
+        const uint8_t* below = rows.below;
+
+        if constexpr (Shape == NeighbourhoodShape::Moore) {
+            for (int j = 0; j < N + 2; j++) {
+                columnWeights[j] = neighbourWeights[above[j]] + neighbourWeights[row[j]] + neighbourWeights[below[j]];
+            }
+        }
+
+        for (int y = 0; y < N; y++) {
+            const uint8_t state = row[y + 1];
+            uint32_t index = state * centerWeight;
+            if constexpr (Shape == NeighbourhoodShape::Moore) {
+                index += columnWeights[y] + columnWeights[y + 1] + columnWeights[y + 2] - neighbourWeights[state];
+            } else {
+                index += neighbourWeights[above[y + 1]] + neighbourWeights[below[y + 1]]
+                    + neighbourWeights[row[y]] + neighbourWeights[row[y + 2]];
+            }
+            writeState<TrackAge>(worldNow, worldNext, x, y, stateLookup[index]);
+        }
+    }
+}
+
+template<NeighbourhoodShape Shape, bool TrackAge>
+void tableNeighbourhoodStep(const World& worldNow, World& worldNext, const int minX, const int maxX) {
+    const int bits = stateBits;
+
+    PaddedRows<uint8_t> rows;
+    rows.start(worldNow, minX);
+
+    for (int x = minX; x < maxX; x++) {
+        if (x > minX) rows.next(worldNow);
+
+        const uint8_t* above = rows.above;
+        const uint8_t* row = rows.row;
+        const uint8_t* below = rows.below;
+
+        if constexpr (Shape == NeighbourhoodShape::Moore) {
+            // West, middle and east columns from high to low bits, each one
+            // the cells above, at and below from low to high
+            const uint32_t mask = (1u << 9 * bits) - 1;
+            const auto column = [&](const int j) -> uint32_t {
+                return above[j] | row[j] << bits | below[j] << 2 * bits;
+            };
+
+            uint32_t index = column(0) << 3 * bits | column(1);
+            for (int y = 0; y < N; y++) {
+                index = (index << 3 * bits | column(y + 2)) & mask;
+                writeState<TrackAge>(worldNow, worldNext, x, y, stateLookup[index]);
+            }
+        } else {
+            // Cells in table order from low to high bits
+            for (int y = 0; y < N; y++) {
+                const uint32_t index = row[y + 1] | above[y + 1] << bits | row[y + 2] << 2 * bits
+                    | below[y + 1] << 3 * bits | row[y] << 4 * bits;
+                writeState<TrackAge>(worldNow, worldNext, x, y, stateLookup[index]);
+            }
+        }
+    }
+}
+
+template<bool TrackAge>
+void tableTransitionStep(const World& worldNow, World& worldNext, const int minX, const int maxX) {
+    const bool moore = stateTable->shape == NeighbourhoodShape::Moore;
+
+    PaddedRows<uint8_t> rows;
+    rows.start(worldNow, minX);
+
+    for (int x = minX; x < maxX; x++) {
+        if (x > minX) rows.next(worldNow);
+
+        const uint8_t* above = rows.above;
+        const uint8_t* row = rows.row;
+        const uint8_t* below = rows.below;
+
+        for (int y = 0; y < N; y++) {
+            const int j = y + 1;
+            uint8_t cells[MAX_TABLE_CELLS];
+            cells[0] = row[j];
+            cells[1] = above[j];
+            if (moore) {
+                const uint8_t ring[] = {above[j + 1], row[j + 1], below[j + 1], below[j], below[j - 1], row[j - 1], above[j - 1]};
+                copy(begin(ring), end(ring), cells + 2);
+            } else {
+                cells[2] = row[j + 1];
+                cells[3] = below[j];
+                cells[4] = row[j - 1];
+            }
+            writeState<TrackAge>(worldNow, worldNext, x, y, stateTable->next(cells));
+        }
+    }
+}
+
+// Next states by (cell state, neighbour state counts) from a representative
+// arrangement of each count
+void compileCountLookup(const RuleTable& table, const int neighbours, const uint32_t base) {
+    uint32_t weight = 1;
+    neighbourWeights[0] = 0;
+    for (int state = 1; state < table.states; state++) {
+        neighbourWeights[state] = weight;
+        weight *= base;
+    }
+    centerWeight = weight;
+    stateLookup.assign(static_cast<size_t>(table.states) * centerWeight, 0);
+
+    uint8_t cells[MAX_TABLE_CELLS] = {};
+    const auto fill = [&](auto& self, const int state, const int position, uint32_t index) -> void {
+        if (state == table.states) {
+            for (int center = 0; center < table.states; center++) {
+                cells[0] = static_cast<uint8_t>(center);
+                stateLookup[center * centerWeight + index] = table.next(cells);
+            }
+            return;
+        }
+        // Positions from `position` on take `state`, as many as the count says
+        for (int count = 0; position + count <= neighbours; count++) {
+            for (int i = position; i < neighbours; i++) {
+                cells[1 + i] = static_cast<uint8_t>(i < position + count ? state : 0);
+            }
+            self(self, state + 1, position + count, index + count * neighbourWeights[state]);
+        }
+    };
+    fill(fill, 1, 0, 0);
+}
+
+void compileNeighbourhoodLookup(const RuleTable& table) {
+    const int cellCount = table.cellCount();
+    const uint32_t fieldMask = (1u << stateBits) - 1;
+    stateLookup.assign(size_t {1} << cellCount * stateBits, 0);
+
+    for (size_t index = 0; index < stateLookup.size(); index++) {
+        uint8_t cells[MAX_TABLE_CELLS];
+        bool valid = true;
+
+        // Field f, from the low bits, is table cell MOORE_ORDER[f]: the east
+        // column NE, E, SE, then the middle one N, C, S and the west one NW, W, SW
+        constexpr int MOORE_ORDER[] = {2, 3, 4, 1, 0, 5, 8, 7, 6};
+        for (int field = 0; field < cellCount; field++) {
+            const uint32_t state = static_cast<uint32_t>(index >> field * stateBits) & fieldMask;
+            valid &= state < static_cast<uint32_t>(table.states);
+            const int cell = table.shape == NeighbourhoodShape::Moore ? MOORE_ORDER[field] : field;
+            cells[cell] = static_cast<uint8_t>(state);
+        }
+
+        if (valid) stateLookup[index] = table.next(cells);
+    }
+}
+
+template<NeighbourhoodShape Shape>
+void setCountKernels(StepKernel& step, StepKernel& stepWithAge) {
+    step = tableCountStep<Shape, false>;
+    stepWithAge = tableCountStep<Shape, true>;
+}
+
+template<NeighbourhoodShape Shape>
+void setNeighbourhoodKernels(StepKernel& step, StepKernel& stepWithAge) {
+    step = tableNeighbourhoodStep<Shape, false>;
+    stepWithAge = tableNeighbourhoodStep<Shape, true>;
+}
+
+void tableKernels(const RuleTable& table, StepKernel& step, StepKernel& stepWithAge) {
+    stateTable = &table;
+
+    const bool moore = table.shape == NeighbourhoodShape::Moore;
+    const int neighbours = table.cellCount() - 1;
+    const uint32_t base = neighbours + 1;
+
+    size_t countEntries = table.states;
+    for (int state = 1; state < table.states && countEntries <= MAX_LOOKUP_ENTRIES; state++) {
+        countEntries *= base;
+    }
+
+    stateBits = bit_width(static_cast<unsigned>(table.states - 1));
+
+    if (table.permute && countEntries <= MAX_LOOKUP_ENTRIES) {
+        compileCountLookup(table, neighbours, base);
+        if (moore) {
+            setCountKernels<NeighbourhoodShape::Moore>(step, stepWithAge);
+        } else {
+            setCountKernels<NeighbourhoodShape::VonNeumann>(step, stepWithAge);
+        }
+    } else if ((size_t {1} << table.cellCount() * stateBits) <= MAX_LOOKUP_ENTRIES) {
+        compileNeighbourhoodLookup(table);
+        if (moore) {
+            setNeighbourhoodKernels<NeighbourhoodShape::Moore>(step, stepWithAge);
+        } else {
+            setNeighbourhoodKernels<NeighbourhoodShape::VonNeumann>(step, stepWithAge);
+        }
+    } else {
+        stateLookup.clear();
+        step = tableTransitionStep<false>;
+        stepWithAge = tableTransitionStep<true>;
+    }
+}
+
+void prepareStateWorlds(const int index) {
+    const size_t cellCount = static_cast<size_t>(N) * N;
+    const int states = simRule().table->states;
+
+    World& world = worlds[index];
+    if (world.States.size() != cellCount) {
+        world.States.resize(cellCount);
+        for (int x = 0; x < N; x++) {
+            for (int y = 0; y < N; y++) {
+                world.stateRow(x)[y] = world.Data[x][y];
+            }
+        }
+    }
+
+    for (int x = 0; x < N; x++) {
+        for (int y = 0; y < N; y++) {
+            uint8_t& state = world.stateRow(x)[y];
+            if (state >= states) state = 0;
+            world.Data[x][y] = state != 0;
+        }
+    }
+
+    for (World& other : worlds) {
+        if (&other != &world) other.States.assign(cellCount, 0);
+    }
+}
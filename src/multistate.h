@@ -0,0 +1,21 @@
+﻿#pragma once
+
+#include "sim.h"
+#include "rule_table.h"
+
+// Rule tables (see rule_table.h) on World::States, one byte per cell, with
+// Data kept as the cells in a non-zero state. A table is compiled into a
+// lookup of next states when one fits in 4M entries:
+//  - permute tables by neighbour state counts: every neighbour adds the
+//    weight of its state (a power of 9, or 5 for von Neumann) to the index,
+//    Moore sums coming from per column sums along the row;
+//  - other tables by the full neighbourhood, one bit field per cell; along a
+//    Moore row the index shifts by a column and takes in the next one, as
+//    isotropic rules do.
+// Larger tables are evaluated per cell from their transition bits.
+void tableKernels(const RuleTable& table, StepKernel& step, StepKernel& stepWithAge);
+
+// Sizes World::States of the three buffers for the current rule and fills
+// that of worlds[index] from its Data, unless it holds the states of a
+// multi-state pattern already. States the rule lacks become 0.
+void prepareStateWorlds(int index);
@@ -0,0 +1,179 @@
+﻿#include "net.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <mutex>
+
+using namespace std;
+
+#ifdef _WIN32
+
+using NativeSocket = SOCKET;
+constexpr int SEND_FLAGS = 0;
+
+bool initSockets() {
+    static once_flag started;
+    static bool ok = false;
+    call_once(started, [] {
+        WSADATA data;
+        ok = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    });
+    return ok;
+}
+
+void closeNative(const NativeSocket socket) {
+    closesocket(socket);
+}
+
+#else
+
+using NativeSocket = int;
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+
+bool initSockets() {
+    return true;
+}
+
+void closeNative(const NativeSocket socket) {
+    close(socket);
+}
+
+#endif
+
+NativeSocket native(const SocketHandle socket) {
+    return static_cast<NativeSocket>(socket);
+}
+
+SocketHandle handle(const NativeSocket socket) {
+    return socket == static_cast<NativeSocket>(-1) ? INVALID_SOCKET_HANDLE : static_cast<SocketHandle>(socket);
+}
+
+addrinfo* resolveTcp(const string& host, const int port, const bool passive) {
+    addrinfo hints {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &result) != 0) return nullptr;
+    return result;
+}
+
+SocketHandle listenTcp(const string& host, const int port) {
+    if (!initSockets()) return INVALID_SOCKET_HANDLE;
+
+    addrinfo* address = resolveTcp(host, port, true);
+    if (address == nullptr) return INVALID_SOCKET_HANDLE;
+
+    const NativeSocket listener = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (handle(listener) == INVALID_SOCKET_HANDLE) {
+        freeaddrinfo(address);
+        return INVALID_SOCKET_HANDLE;
+    }
+
+    const int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    const bool listening = ::bind(listener, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0
+        && listen(listener, 8) == 0;
+    freeaddrinfo(address);
+
+    if (!listening) {
+        closeNative(listener);
+        return INVALID_SOCKET_HANDLE;
+    }
+    return handle(listener);
+}
+
+SocketHandle acceptTcp(const SocketHandle listener, const int timeoutMs) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(native(listener), &readable);
+    timeval timeout {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+
+    if (select(static_cast<int>(native(listener)) + 1, &readable, nullptr, nullptr, &timeout) <= 0) {
+        return INVALID_SOCKET_HANDLE;
+    }
+
+    const NativeSocket client = accept(native(listener), nullptr, nullptr);
+    if (handle(client) == INVALID_SOCKET_HANDLE) return INVALID_SOCKET_HANDLE;
+
+    // Frames are written in one go, don't hold back their tails
+    const int noDelay = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+    return handle(client);
+}
+
+SocketHandle connectTcp(const string& host, const int port) {
+    if (!initSockets()) return INVALID_SOCKET_HANDLE;
+
+    addrinfo* address = resolveTcp(host, port, false);
+    if (address == nullptr) return INVALID_SOCKET_HANDLE;
+
+    const NativeSocket connection = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (handle(connection) == INVALID_SOCKET_HANDLE) {
+        freeaddrinfo(address);
+        return INVALID_SOCKET_HANDLE;
+    }
+
+    const bool connected = connect(connection, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0;
+    freeaddrinfo(address);
+
+    if (!connected) {
+        closeNative(connection);
+        return INVALID_SOCKET_HANDLE;
+    }
+    return handle(connection);
+}
+
+bool sendAll(const SocketHandle socket, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        const int chunk = static_cast<int>(min<size_t>(size, 1 << 20));
+        const auto sent = send(native(socket), bytes, chunk, SEND_FLAGS);
+        if (sent <= 0) return false;
+
+        bytes += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool receiveAll(const SocketHandle socket, void* data, size_t size) {
+    char* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        const int chunk = static_cast<int>(min<size_t>(size, 1 << 20));
+        const auto received = recv(native(socket), bytes, chunk, 0);
+        if (received <= 0) return false;
+
+        bytes += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+void shutdownSocket(const SocketHandle socket) {
+#ifdef _WIN32
+    shutdown(native(socket), SD_BOTH);
+#else
+    shutdown(native(socket), SHUT_RDWR);
+#endif
+}
+
+void closeSocket(const SocketHandle socket) {
+    closeNative(native(socket));
+}
@@ -0,0 +1,24 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Minimal blocking TCP sockets over BSD sockets / Winsock.
+using SocketHandle = intptr_t;
+constexpr SocketHandle INVALID_SOCKET_HANDLE = -1;
+
+// Listens on host:port, e.g. 127.0.0.1 to only accept local connections.
+SocketHandle listenTcp(const std::string& host, int port);
+
+// Waits up to `timeoutMs` for a connection, INVALID_SOCKET_HANDLE if none came.
+SocketHandle acceptTcp(SocketHandle listener, int timeoutMs);
+
+SocketHandle connectTcp(const std::string& host, int port);
+
+bool sendAll(SocketHandle socket, const void* data, size_t size);
+bool receiveAll(SocketHandle socket, void* data, size_t size);
+
+// Makes pending and future sends and receives on the socket fail.
+void shutdownSocket(SocketHandle socket);
+void closeSocket(SocketHandle socket);
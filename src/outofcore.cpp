@@ -0,0 +1,173 @@
+﻿#include "outofcore.h"
+#include "bitlife.h"
+#include "mapped_file.h"
+#include "seed.h"
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct OutOfCoreState {
+    int64_t size = 0;
+    int wordsPerRow = 0;
+    size_t rowBytes = 0;
+    int64_t bandRows = 0;
+    int64_t bandCount = 0;
+    int prefetchBands = 0;
+
+    MappedFile files[2];
+    MappedFile* input = nullptr;
+    MappedFile* output = nullptr;
+
+    int64_t band = 0;
+    int64_t generation = 0;
+    atomic<int64_t> nextRow {0};
+    int64_t bandEnd = 0;
+    bool stop = false;
+
+    int generationLimit = 0;
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max();
+
+    size_t bandOffset(const int64_t b) const { return static_cast<size_t>(b * bandRows) * rowBytes; }
+    size_t bandLength() const { return static_cast<size_t>(bandRows) * rowBytes; }
+
+    const uint64_t* inputRow(const int64_t row) const {
+        return reinterpret_cast<const uint64_t*>(input->data + static_cast<size_t>((row + size) % size) * rowBytes);
+    }
+    uint64_t* outputRow(const int64_t row) const {
+        return reinterpret_cast<uint64_t*>(output->data + static_cast<size_t>(row) * rowBytes);
+    }
+
+    void startBand() {
+        nextRow = band * bandRows;
+        bandEnd = min(size, (band + 1) * bandRows);
+
+        for (int ahead = 1; ahead <= prefetchBands; ahead++) {
+            input->willNeed(bandOffset((band + ahead) % bandCount), bandLength());
+        }
+    }
+
+    // Runs on one thread once every worker finished the current band
+    void finishBand() noexcept {
+        // The band's output is final: start writing it back and release it.
+        // The previous input band was only kept for this band's upper halo.
+        output->flushAsync(bandOffset(band), bandLength());
+        output->dontNeed(bandOffset(band), bandLength());
+        if (band > 0) {
+            input->dontNeed(bandOffset(band - 1), bandLength());
+        }
+
+        if (++band == bandCount) {
+            input->dontNeed(bandOffset(bandCount - 1), bandLength());
+            band = 0;
+            ++generation;
+            swap(input, output);
+
+            stop = generation == generationLimit || chrono::steady_clock::now() >= deadline;
+        }
+
+        startBand();
+    }
+};
+
+void seedOutOfCoreWorld(OutOfCoreState& state, const SeedSettings& seed, const int workerCount) {
+    const uint64_t key = seedKey(seed.seed);
+    const uint64_t threshold = seedThreshold(seed.density);
+    atomic<int64_t> nextRow {0};
+    vector<thread> workers;
+
+    for (int wi = 0; wi < workerCount; wi++) {
+        workers.emplace_back([&] {
+            for (int64_t row; (row = nextRow++) < state.size;) {
+                uint64_t* words = state.outputRow(row);
+                for (int i = 0; i < state.wordsPerRow; i++) {
+                    words[i] = seedWord(key, threshold, static_cast<uint64_t>(i) * 64, row);
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    state.output->flushAsync(0, state.output->size);
+    state.output->dontNeed(0, state.output->size);
+}
+
+int runOutOfCore(const OutOfCoreSettings& settings) {
+    OutOfCoreState state;
+    state.size = (settings.size + 63) / 64 * 64;
+    state.wordsPerRow = static_cast<int>(state.size / 64);
+    state.rowBytes = static_cast<size_t>(state.wordsPerRow) * sizeof(uint64_t);
+    state.bandRows = clamp<int64_t>(settings.bandRows, 1, state.size);
+    state.bandCount = (state.size + state.bandRows - 1) / state.bandRows;
+    state.prefetchBands = max(0, settings.prefetchBands);
+    state.generationLimit = settings.generations;
+
+    const int workerCount = settings.workerCount > 0
+        ? settings.workerCount : max(1, static_cast<int>(thread::hardware_concurrency()));
+    const size_t fileSize = state.rowBytes * static_cast<size_t>(state.size);
+
+    if (state.size != settings.size) {
+        cerr << format("Out-of-core world rounded up to {}x{} cells\n", state.size, state.size);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        const filesystem::path path = filesystem::path(settings.directory) / format("ooc_world_{}.bin", i);
+        if (!state.files[i].create(path.string(), fileSize)) {
+            cerr << format("Cannot create {} byte world file '{}'\n", fileSize, path.string());
+            return 1;
+        }
+    }
+
+    state.output = &state.files[0];
+    seedOutOfCoreWorld(state, settings.seed, workerCount);
+
+    state.input = &state.files[0];
+    state.output = &state.files[1];
+
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if (settings.durationSeconds > 0) {
+        state.deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(
+            chrono::duration<float>(settings.durationSeconds));
+    }
+
+    state.startBand();
+
+    barrier bandDone {workerCount, [&state]() noexcept { state.finishBand(); }};
+    vector<thread> workers;
+
+    for (int wi = 0; wi < workerCount; wi++) {
+        workers.emplace_back([&] {
+            while (!state.stop) {
+                for (int64_t row; (row = state.nextRow++) < state.bandEnd;) {
+                    lifeRowStep(state.inputRow(row - 1), state.inputRow(row), state.inputRow(row + 1),
+                        state.outputRow(row), state.wordsPerRow);
+                }
+                bandDone.arrive_and_wait();
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    const double seconds = elapsed.count();
+    const double cells = static_cast<double>(state.size) * static_cast<double>(state.size);
+    const double bytesMoved = 2.0 * static_cast<double>(fileSize) * static_cast<double>(state.generation);
+
+    cout << format("size {}\ngenerations {}\nseconds {:.3f}\ngenerations/s {:.3f}\ncells/s {:.3e}\nio GB/s {:.2f}\n",
+        state.size, state.generation, seconds, state.generation / seconds,
+        cells * state.generation / seconds, bytesMoved / seconds / 1e9);
+
+    return 0;
+}
@@ -0,0 +1,23 @@
+﻿#pragma once
+
+#include "seed.h"
+
+#include <cstdint>
+#include <string>
+
+struct OutOfCoreSettings {
+    int64_t size = 0;           // cells per side, rounded up to a multiple of 64
+    std::string directory = ".";
+    int bandRows = 256;         // rows streamed through the workers at a time
+    int prefetchBands = 2;      // bands of the current generation read ahead
+    int workerCount = 0;        // 0 = hardware concurrency
+    SeedSettings seed;          // region ignored, the whole world is seeded
+    int generations = 0;        // 0 = unbounded
+    float durationSeconds = 0;  // 0 = unbounded
+};
+
+// Simulates a bit-packed size x size torus kept in two memory-mapped files,
+// one per generation, and prints a throughput summary. Rows are streamed
+// band by band through the workers, with read-ahead on the input file and
+// write-behind plus page release behind the band being computed.
+int runOutOfCore(const OutOfCoreSettings& settings);
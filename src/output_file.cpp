@@ -0,0 +1,127 @@
+﻿#include "output_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+using namespace std;
+
+uint8_t* allocateAligned(const size_t bytes) {
+    auto* data = static_cast<uint8_t*>(::operator new(bytes, align_val_t {DIRECT_IO_ALIGNMENT}));
+    memset(data, 0, bytes);
+    return data;
+}
+
+void freeAligned(uint8_t* data) {
+    ::operator delete(data, align_val_t {DIRECT_IO_ALIGNMENT});
+}
+
+#ifdef _WIN32
+
+HANDLE createOutputHandle(const string& path, const DWORD flags) {
+    return CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, flags, nullptr);
+}
+
+bool OutputFile::create(const string& path, const bool wantDirect) {
+    close();
+
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    if (wantDirect) {
+        handle = createOutputHandle(path, FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH);
+    }
+    direct = handle != INVALID_HANDLE_VALUE;
+    if (!direct) {
+        handle = createOutputHandle(path, FILE_ATTRIBUTE_NORMAL);
+    }
+    if (handle == INVALID_HANDLE_VALUE) return false;
+
+    fileHandle = handle;
+    return true;
+}
+
+bool OutputFile::writeAt(const void* data, size_t length, uint64_t offset) const {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+
+    while (length > 0) {
+        OVERLAPPED position {};
+        position.Offset = static_cast<DWORD>(offset);
+        position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        // Chunks below 4 GiB that keep the alignment of direct writes
+        const DWORD chunk = static_cast<DWORD>(min<size_t>(length, 1u << 30));
+        DWORD written = 0;
+        if (!WriteFile(fileHandle, bytes, chunk, &written, &position) || written == 0) return false;
+
+        bytes += written;
+        length -= written;
+        offset += written;
+    }
+    return true;
+}
+
+bool OutputFile::truncate(const uint64_t fileSize) const {
+    // Unbuffered handles can only end files at sector boundaries
+    if (direct) return true;
+
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(fileSize);
+    return SetFilePointerEx(fileHandle, end, nullptr, FILE_BEGIN) && SetEndOfFile(fileHandle);
+}
+
+void OutputFile::close() {
+    if (fileHandle != nullptr) CloseHandle(fileHandle);
+    fileHandle = nullptr;
+}
+
+#else
+
+bool OutputFile::create(const string& path, const bool wantDirect) {
+    close();
+
+    constexpr int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    direct = false;
+#ifdef O_DIRECT
+    if (wantDirect) {
+        fd = open(path.c_str(), flags | O_DIRECT, 0644);
+        direct = fd >= 0;
+    }
+#endif
+    if (!direct) {
+        fd = open(path.c_str(), flags, 0644);
+    }
+    return fd >= 0;
+}
+
+bool OutputFile::writeAt(const void* data, size_t length, uint64_t offset) const {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+
+    while (length > 0) {
+        const ssize_t written = pwrite(fd, bytes, length, static_cast<off_t>(offset));
+        if (written <= 0) return false;
+
+        bytes += written;
+        length -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+    return true;
+}
+
+bool OutputFile::truncate(const uint64_t fileSize) const {
+    return ftruncate(fd, static_cast<off_t>(fileSize)) == 0;
+}
+
+void OutputFile::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+}
+
+#endif
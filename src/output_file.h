@@ -0,0 +1,47 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Block size that offsets, lengths and buffer addresses of unbuffered writes
+// are aligned to; a multiple of the sector size of any common disk.
+constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+
+constexpr size_t alignToDirectIo(const size_t bytes) {
+    return (bytes + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+}
+
+// Zero-filled memory aligned for unbuffered writes.
+uint8_t* allocateAligned(size_t bytes);
+void freeAligned(uint8_t* data);
+
+// Positional writes to a new file (pwrite / WriteFile with an offset).
+struct OutputFile {
+    OutputFile() = default;
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+    ~OutputFile() { close(); }
+
+    // Creates or truncates the file. With `direct` the page cache is bypassed
+    // (O_DIRECT / FILE_FLAG_NO_BUFFERING) and every write must be aligned to
+    // DIRECT_IO_ALIGNMENT; if the file system refuses, the file is opened
+    // buffered and `direct` reads false afterwards.
+    bool create(const std::string& path, bool wantDirect);
+
+    bool writeAt(const void* data, size_t length, uint64_t offset) const;
+
+    // Cuts the alignment padding of the last write off the file.
+    bool truncate(uint64_t fileSize) const;
+
+    void close();
+
+    bool direct = false;
+
+private:
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
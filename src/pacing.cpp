@@ -0,0 +1,95 @@
+﻿#include "pacing.h"
+#include "sim.h"
+
+#include <algorithm>
+#include <thread>
+
+using namespace std;
+
+bool parsePacingMode(const string_view name, PacingMode& mode) {
+    if (name == "free") {
+        mode = PacingMode::Free;
+    } else if (name == "sync") {
+        mode = PacingMode::Sync;
+    } else if (name == "latest") {
+        mode = PacingMode::Latest;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* pacingModeName(const PacingMode mode) {
+    switch (mode) {
+        case PacingMode::Sync: return "sync";
+        case PacingMode::Latest: return "latest";
+        default: return "free";
+    }
+}
+
+void LatencyTracker::add(const World& displayed, const chrono::steady_clock::time_point presentedAt) {
+    // The seeded world was never produced by the sim
+    if (displayed.Generation == 0) return;
+
+    const chrono::duration<float, milli> latency = presentedAt - displayed.CompletedAt;
+    windowSumMs += latency.count();
+    windowMaxMs = max(windowMaxMs, latency.count());
+    ++windowCount;
+
+    if (presentedAt - windowStart > chrono::milliseconds(500)) {
+        averageMs = static_cast<float>(windowSumMs / windowCount);
+        maxMs = windowMaxMs;
+
+        windowStart = presentedAt;
+        windowSumMs = 0;
+        windowMaxMs = 0;
+        windowCount = 0;
+    }
+}
+
+FramePacer::FramePacer(const PacingSettings& settings)
+    : settings(settings),
+      framePeriod(chrono::duration_cast<chrono::steady_clock::duration>(
+          chrono::duration<double>(1.0 / max(1, settings.targetFps)))) {
+    nextPresent = chrono::steady_clock::now() + framePeriod;
+
+    if (settings.mode == PacingMode::Sync) {
+        enableSimPacing();
+    }
+}
+
+void waitUntil(const chrono::steady_clock::time_point deadline) {
+    // Sleep coarsely, then spin the last millisecond to avoid oversleeping
+    constexpr chrono::milliseconds SPIN_WINDOW {1};
+
+    if (deadline - chrono::steady_clock::now() > SPIN_WINDOW) {
+        this_thread::sleep_until(deadline - SPIN_WINDOW);
+    }
+    while (chrono::steady_clock::now() < deadline) { }
+}
+
+void FramePacer::waitForHandover() {
+    if (settings.mode == PacingMode::Latest) {
+        // Leave a quarter of the measured render cost as safety margin
+        waitUntil(nextPresent - renderCost - renderCost / 4);
+    }
+
+    frameStart = chrono::steady_clock::now();
+
+    if (settings.mode == PacingMode::Sync && simIndex >= requestedGeneration) {
+        requestedGeneration = simIndex + settings.gensPerFrame;
+        releaseSimGenerations(settings.gensPerFrame);
+    }
+}
+
+void FramePacer::framePresented(const chrono::steady_clock::time_point presentedAt) {
+    if (settings.mode != PacingMode::Latest) return;
+
+    // Exponential moving average of handover-to-present time
+    renderCost = (renderCost * 7 + (presentedAt - frameStart)) / 8;
+
+    nextPresent += framePeriod;
+    if (nextPresent < presentedAt) {
+        nextPresent = presentedAt + framePeriod;
+    }
+}
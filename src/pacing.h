@@ -0,0 +1,55 @@
+﻿#pragma once
+
+#include "world.h"
+
+#include <chrono>
+#include <string_view>
+
+enum class PacingMode {
+    Free,   // sim and render run unthrottled, render shows whatever is newest
+    Sync,   // sim computes exactly gensPerFrame generations per displayed frame
+    Latest, // render sleeps until just before its deadline, then takes the newest buffer
+};
+
+bool parsePacingMode(std::string_view name, PacingMode& mode);
+const char* pacingModeName(PacingMode mode);
+
+struct PacingSettings {
+    PacingMode mode = PacingMode::Free;
+    int targetFps = 60;
+    int gensPerFrame = 1;
+};
+
+// Sim-to-photon latency: time between a generation being completed by the
+// sim and the frame showing it being presented, aggregated over ~0.5 s.
+struct LatencyTracker {
+    void add(const World& displayed, std::chrono::steady_clock::time_point presentedAt);
+
+    float averageMs = 0;
+    float maxMs = 0;
+
+private:
+    std::chrono::steady_clock::time_point windowStart;
+    double windowSumMs = 0;
+    float windowMaxMs = 0;
+    int windowCount = 0;
+};
+
+struct FramePacer {
+    explicit FramePacer(const PacingSettings& settings);
+
+    // Blocks until the render thread should take a buffer for the next frame.
+    void waitForHandover();
+
+    // Tells the pacer the frame started at waitForHandover() has been presented.
+    void framePresented(std::chrono::steady_clock::time_point presentedAt);
+
+    PacingSettings settings;
+
+private:
+    std::chrono::steady_clock::duration framePeriod;
+    std::chrono::steady_clock::duration renderCost {};
+    std::chrono::steady_clock::time_point frameStart;
+    std::chrono::steady_clock::time_point nextPresent;
+    int requestedGeneration = 0;
+};
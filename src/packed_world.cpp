@@ -0,0 +1,76 @@
+﻿#include "packed_world.h"
+
+#include <cstring>
+
+using namespace std;
+
+void packWorld(const World& world, uint64_t* words) {
+    for (int x = 0; x < N; x++) {
+        packCells(world.Data[x], N, words + static_cast<size_t>(x) * packedRowWords());
+    }
+}
+
+void unpackWorld(const uint64_t* words, World& world) {
+    for (int x = 0; x < N; x++) {
+        unpackCells(words + static_cast<size_t>(x) * packedRowWords(), N, world.Data[x]);
+    }
+}
+
+void putVarint(vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+bool getVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7) {
+        const uint8_t byte = *in++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+void encodeWords(const uint64_t* words, const size_t count, vector<uint8_t>& out) {
+    size_t i = 0;
+    while (i < count) {
+        const size_t zeroStart = i;
+        while (i < count && words[i] == 0) i++;
+        const size_t literalStart = i;
+        while (i < count && words[i] != 0) i++;
+
+        putVarint(out, literalStart - zeroStart);
+        putVarint(out, i - literalStart);
+
+        const size_t offset = out.size();
+        out.resize(offset + (i - literalStart) * sizeof(uint64_t));
+        memcpy(out.data() + offset, words + literalStart, (i - literalStart) * sizeof(uint64_t));
+    }
+}
+
+bool decodeWords(const uint8_t* in, const uint8_t* end, uint64_t* words, const size_t count, const bool keyframe) {
+    size_t i = 0;
+    while (i < count) {
+        uint64_t zeros;
+        uint64_t literals;
+        if (!getVarint(in, end, zeros) || !getVarint(in, end, literals)) return false;
+        if (zeros > count - i || literals > count - i - zeros) return false;
+        if (static_cast<uint64_t>(end - in) < literals * sizeof(uint64_t)) return false;
+
+        if (keyframe) {
+            memset(words + i, 0, zeros * sizeof(uint64_t));
+        }
+        i += zeros;
+
+        for (uint64_t j = 0; j < literals; j++, i++) {
+            uint64_t word;
+            memcpy(&word, in, sizeof(word));
+            in += sizeof(word);
+            words[i] = keyframe ? word : words[i] ^ word;
+        }
+    }
+    return in == end;
+}
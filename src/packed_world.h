@@ -0,0 +1,30 @@
+﻿#pragma once
+
+#include "world.h"
+#include "bitpack.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Whole worlds as bit-packed rows, and the word coding shared by the
+// generation log and the stream server: a sequence of
+// (varint zero word run, varint literal word count, literal words).
+inline int packedRowWords() { return packedWordCount(N); }
+inline size_t packedWorldWords() { return static_cast<size_t>(packedRowWords()) * N; }
+
+void packWorld(const World& world, uint64_t* words);
+void unpackWorld(const uint64_t* words, World& world);
+
+void putVarint(std::vector<uint8_t>& out, uint64_t value);
+bool getVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value);
+
+void encodeWords(const uint64_t* words, size_t count, std::vector<uint8_t>& out);
+
+// Most bytes encodeWords writes for `count` words: all of them literal, each
+// in a run of its own behind two varints.
+constexpr size_t MAX_VARINT_BYTES = 10;
+inline size_t maxEncodedSize(const size_t count) { return count * (sizeof(uint64_t) + 2 * MAX_VARINT_BYTES); }
+
+// Keyframes overwrite `words`, deltas are XORed into it.
+bool decodeWords(const uint8_t* in, const uint8_t* end, uint64_t* words, size_t count, bool keyframe);
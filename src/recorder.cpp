@@ -0,0 +1,254 @@
+﻿#include "recorder.h"
+
+#include "external/stb_image_write.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+using namespace std;
+
+struct RecordedFrame {
+    World world;
+    int generation = 0;
+    int sequence = 0;
+};
+
+RecorderSettings recorderSettings;
+atomic<bool> recorderActive {false};
+
+mutex recorderMutex;
+condition_variable frameFreed;
+condition_variable frameReady;
+vector<unique_ptr<RecordedFrame>> freeFrames;
+deque<unique_ptr<RecordedFrame>> readyFrames;
+bool recorderStopping = false;
+int nextSequence = 0;
+
+mutex streamMutex;
+condition_variable streamTurn;
+int nextStreamSequence = 0;
+FILE* stream = nullptr;
+
+vector<thread> encoders;
+
+atomic<int> capturedCount {0};
+atomic<int> droppedCount {0};
+atomic<int> writtenCount {0};
+
+bool parseRecordFormat(const string_view name, RecordFormat& format) {
+    if (name == "png") {
+        format = RecordFormat::Png;
+    } else if (name == "y4m") {
+        format = RecordFormat::Y4m;
+    } else if (name == "raw") {
+        format = RecordFormat::Raw;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parseRecordOverflowPolicy(const string_view name, RecordOverflowPolicy& policy) {
+    if (name == "block") {
+        policy = RecordOverflowPolicy::Block;
+    } else if (name == "drop") {
+        policy = RecordOverflowPolicy::Drop;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool recorderWritesToStdout(const RecorderSettings& settings) {
+    return settings.format != RecordFormat::None && settings.format != RecordFormat::Png && settings.path == "-";
+}
+
+void convertToGray(const World& world, uint8_t* pixels) {
+    const bool* cells = &world.Data[0][0];
+    for (int i = 0; i < N * N; i++) {
+        pixels[i] = cells[i] ? 0xFF : 0x00;
+    }
+}
+
+void writeStreamFrame(const uint8_t* pixels, const int sequence) {
+    unique_lock lock(streamMutex);
+    streamTurn.wait(lock, [&] { return nextStreamSequence == sequence; });
+
+    if (recorderSettings.format == RecordFormat::Y4m) {
+        fputs("FRAME\n", stream);
+    }
+    fwrite(pixels, 1, static_cast<size_t>(N) * N, stream);
+
+    ++nextStreamSequence;
+    lock.unlock();
+    streamTurn.notify_all();
+}
+
+void recorderEncoder() {
+    vector<uint8_t> pixels(static_cast<size_t>(N) * N);
+
+    while (true) {
+        unique_ptr<RecordedFrame> frame;
+        {
+            unique_lock lock(recorderMutex);
+            frameReady.wait(lock, [] { return recorderStopping || !readyFrames.empty(); });
+            if (readyFrames.empty()) return;
+
+            frame = move(readyFrames.front());
+            readyFrames.pop_front();
+        }
+
+        convertToGray(frame->world, pixels.data());
+        const int generation = frame->generation;
+        const int sequence = frame->sequence;
+
+        {
+            lock_guard lock(recorderMutex);
+            freeFrames.push_back(move(frame));
+        }
+        frameFreed.notify_one();
+
+        if (recorderSettings.format == RecordFormat::Png) {
+            const string fileName = format("{}/gen_{:08}.png", recorderSettings.path, generation);
+            if (!stbi_write_png(fileName.c_str(), N, N, 1, pixels.data(), N)) {
+                cerr << format("Recorder failed to write '{}'\n", fileName);
+                continue;
+            }
+        } else {
+            writeStreamFrame(pixels.data(), sequence);
+        }
+
+        ++writtenCount;
+    }
+}
+
+bool openRecorderOutput() {
+    if (recorderSettings.format == RecordFormat::Png) {
+        error_code error;
+        filesystem::create_directories(recorderSettings.path, error);
+        if (error) {
+            cerr << format("Recorder cannot create '{}': {}\n", recorderSettings.path, error.message());
+            return false;
+        }
+        return true;
+    }
+
+    if (recorderSettings.path == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        stream = stdout;
+    } else {
+        stream = fopen(recorderSettings.path.c_str(), "wb");
+        if (stream == nullptr) {
+            cerr << format("Recorder cannot open '{}'\n", recorderSettings.path);
+            return false;
+        }
+    }
+
+    if (recorderSettings.format == RecordFormat::Y4m) {
+        fputs(format("YUV4MPEG2 W{} H{} F30:1 Ip A1:1 Cmono\n", N, N).c_str(), stream);
+    }
+    return true;
+}
+
+bool startRecorder(const RecorderSettings& settings) {
+    if (settings.format == RecordFormat::None) return true;
+
+    recorderSettings = settings;
+    recorderSettings.every = max(1, settings.every);
+
+    if (!openRecorderOutput()) return false;
+
+    // Reset what an earlier run in this process left behind
+    recorderStopping = false;
+    nextSequence = 0;
+    nextStreamSequence = 0;
+    capturedCount = 0;
+    droppedCount = 0;
+    writtenCount = 0;
+    freeFrames.clear();
+
+    for (int i = 0; i < max(1, settings.queueCapacity); i++) {
+        freeFrames.push_back(make_unique<RecordedFrame>());
+    }
+
+    for (int i = 0; i < max(1, settings.encoderCount); i++) {
+        encoders.emplace_back(recorderEncoder);
+    }
+
+    recorderActive = true;
+    return true;
+}
+
+void recorderCapture(const World& world, const int generation) {
+    if (!recorderActive || generation % recorderSettings.every != 0) return;
+
+    unique_ptr<RecordedFrame> frame;
+    {
+        unique_lock lock(recorderMutex);
+        if (recorderSettings.overflowPolicy == RecordOverflowPolicy::Block) {
+            frameFreed.wait(lock, [] { return !freeFrames.empty(); });
+        } else if (freeFrames.empty()) {
+            ++droppedCount;
+            return;
+        }
+
+        frame = move(freeFrames.back());
+        freeFrames.pop_back();
+    }
+
+    frame->world.copyFrom(world);
+    frame->generation = generation;
+
+    {
+        lock_guard lock(recorderMutex);
+        frame->sequence = nextSequence++;
+        readyFrames.push_back(move(frame));
+    }
+    frameReady.notify_one();
+
+    ++capturedCount;
+}
+
+void stopRecorder() {
+    if (!recorderActive) return;
+    recorderActive = false;
+
+    {
+        lock_guard lock(recorderMutex);
+        recorderStopping = true;
+    }
+    frameReady.notify_all();
+
+    for (auto& encoder : encoders) {
+        encoder.join();
+    }
+    encoders.clear();
+
+    if (stream != nullptr) {
+        fflush(stream);
+        if (stream != stdout) {
+            fclose(stream);
+        }
+        stream = nullptr;
+    }
+
+    cerr << format("Recorder captured {} generations, wrote {}, dropped {}\n",
+        capturedCount.load(), writtenCount.load(), droppedCount.load());
+}
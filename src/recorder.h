@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include "world.h"
+
+#include <string>
+#include <string_view>
+
+enum class RecordFormat {
+    None,
+    Png,    // one grayscale PNG per generation, written into a directory
+    Y4m,    // YUV4MPEG2 monochrome stream
+    Raw,    // headerless 8-bit gray frames, N x N bytes each
+};
+
+enum class RecordOverflowPolicy {
+    Block,  // the sim waits for a free frame slot (backpressure)
+    Drop,   // the generation is skipped and counted as dropped
+};
+
+struct RecorderSettings {
+    RecordFormat format = RecordFormat::None;
+    std::string path = "-";     // directory for PNG, file or "-" (stdout) for streams
+    int every = 1;              // capture every k-th generation
+    int encoderCount = 2;
+    int queueCapacity = 8;      // frame slots, each one World in size
+    RecordOverflowPolicy overflowPolicy = RecordOverflowPolicy::Drop;
+};
+
+bool parseRecordFormat(std::string_view name, RecordFormat& format);
+bool parseRecordOverflowPolicy(std::string_view name, RecordOverflowPolicy& policy);
+
+bool recorderWritesToStdout(const RecorderSettings& settings);
+
+bool startRecorder(const RecorderSettings& settings);
+
+// Called by the sim thread once a generation is complete. Only copies the
+// world into a free frame slot; encoding and I/O happen on the encoder pool.
+void recorderCapture(const World& world, int generation);
+
+// Drains the queue, joins the encoders and prints the capture counters.
+void stopRecorder();
@@ -0,0 +1,313 @@
+﻿#include "rle.h"
+#include "rule.h"
+#include "generations.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Minimal buffered reader so multi-megabyte patterns are parsed straight
+// from fixed-size chunks instead of being copied into one big string.
+struct RleReader {
+    static constexpr size_t CHUNK_SIZE = 1 << 16;
+
+    explicit RleReader(FILE* file) : file(file) {}
+
+    int get() {
+        if (position == size) {
+            size = fread(chunk, 1, CHUNK_SIZE, file);
+            position = 0;
+            if (size == 0) return EOF;
+        }
+        return static_cast<unsigned char>(chunk[position++]);
+    }
+
+    string readLine(int c) {
+        string line;
+        for (; c != EOF && c != '\n'; c = get()) {
+            if (c != '\r') line += static_cast<char>(c);
+        }
+        return line;
+    }
+
+    void skipLine() {
+        for (int c = get(); c != EOF && c != '\n'; c = get()) { }
+    }
+
+    FILE* file;
+    char chunk[CHUNK_SIZE];
+    size_t size = 0;
+    size_t position = 0;
+};
+
+string_view trim(string_view text) {
+    while (!text.empty() && isspace(static_cast<unsigned char>(text.front()))) text.remove_prefix(1);
+    while (!text.empty() && isspace(static_cast<unsigned char>(text.back()))) text.remove_suffix(1);
+    return text;
+}
+
+// Parses "x = 3, y = 3, rule = B3/S23". The rule comes last and may hold
+// commas itself ("R5,C0,M1,S34..58,B34..45,NM"), so it takes the rest.
+void parseRleHeader(const string_view header, RlePattern& pattern) {
+    size_t start = 0;
+    while (start < header.size()) {
+        size_t end = min(header.find(',', start), header.size());
+        const size_t equals = header.substr(start, end - start).find('=');
+        if (equals != string_view::npos && trim(header.substr(start, equals)) == "rule") {
+            end = header.size();
+        }
+
+        const string_view field = header.substr(start, end - start);
+        start = end + 1;
+        if (equals == string_view::npos) continue;
+
+        const string_view key = trim(field.substr(0, equals));
+        const string value {trim(field.substr(equals + 1))};
+
+        if (key == "x") {
+            pattern.width = atoi(value.c_str());
+        } else if (key == "y") {
+            pattern.height = atoi(value.c_str());
+        } else if (key == "rule") {
+            pattern.rule = value;
+        }
+    }
+}
+
+int wrap(const int coordinate) {
+    return (coordinate % N + N) % N;
+}
+
+// Cells in a state above 1 go to World::States, set up from Data on the first
+void writeCellState(World& world, const int x, const int y, const int state) {
+    if (state > 1 && world.States.empty()) {
+        world.States.resize(static_cast<size_t>(N) * N);
+        for (int row = 0; row < N; row++) {
+            for (int column = 0; column < N; column++) {
+                world.stateRow(row)[column] = world.Data[row][column];
+            }
+        }
+    }
+
+    world.Data[x][y] = true;
+    if (!world.States.empty()) {
+        world.stateRow(x)[y] = static_cast<uint8_t>(state);
+    }
+}
+
+bool parseRle(FILE* file, World* world, const int left, const int top, RlePattern& pattern) {
+    const auto reader = make_unique<RleReader>(file);
+
+    bool atLineStart = true;
+    bool headerSeen = false;
+    int run = 0;
+    int row = 0;
+    int column = 0;
+
+    for (int c = reader->get(); c != EOF; c = reader->get()) {
+        if (atLineStart && c == '#') {
+            reader->skipLine();
+            continue;
+        }
+        if (atLineStart && c == 'x' && !headerSeen) {
+            parseRleHeader(reader->readLine(c), pattern);
+            headerSeen = true;
+            if (world == nullptr) return true;
+            continue;
+        }
+
+        atLineStart = c == '\n';
+        if (isspace(c)) continue;
+
+        // Only the header was asked for and the data started without one
+        if (world == nullptr) return false;
+
+        if (isdigit(c)) {
+            run = run * 10 + (c - '0');
+            continue;
+        }
+
+        const int count = max(run, 1);
+        run = 0;
+
+        // Multi-state patterns: states 1 to 24 are A to X, then each prefix
+        // p to y adds 24 to the letter that follows, as stateTag writes them
+        int state = 1;
+        if ('p' <= c && c <= 'y') {
+            state = 24 * (c - 'p' + 1) + 1;
+            c = reader->get();
+        }
+
+        if (c == 'b' || c == '.') {
+            column += count;
+        } else if (c == 'o' || ('A' <= c && c <= 'X')) {
+            if (c != 'o') state = min(state + (c - 'A'), MAX_RULE_STATES - 1);
+            for (int i = 0; i < count; i++) {
+                writeCellState(*world, wrap(top + row), wrap(left + column + i), state);
+            }
+            column += count;
+        } else if (c == '$') {
+            row += count;
+            column = 0;
+        } else if (c == '!') {
+            return true;
+        } else {
+            cerr << format("Unexpected character '{}' in RLE data\n", static_cast<char>(c));
+            return false;
+        }
+    }
+
+    // Tolerate a missing terminator, Golly does too
+    return world != nullptr;
+}
+
+bool readRleHeader(const string& path, RlePattern& pattern) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        cerr << format("Cannot open RLE file '{}'\n", path);
+        return false;
+    }
+
+    const bool parsed = parseRle(file, nullptr, 0, 0, pattern);
+    fclose(file);
+
+    return parsed;
+}
+
+bool importRle(const string& path, World& world, const int left, const int top, RlePattern& pattern) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        cerr << format("Cannot open RLE file '{}'\n", path);
+        return false;
+    }
+
+    const bool parsed = parseRle(file, &world, left, top, pattern);
+    fclose(file);
+
+    if (!parsed) {
+        cerr << format("Failed to parse RLE file '{}'\n", path);
+    }
+    return parsed;
+}
+
+// Collects run tokens into lines of at most 70 characters, as RLE requires.
+struct RleWriter {
+    static constexpr int MAX_LINE_LENGTH = 70;
+
+    explicit RleWriter(FILE* file) : file(file) {}
+
+    void emit(const int count, const string_view tag) {
+        if (count <= 0) return;
+
+        const string token = count > 1 ? format("{}{}", count, tag) : string(tag);
+        if (lineLength + static_cast<int>(token.size()) > MAX_LINE_LENGTH) {
+            fputc('\n', file);
+            lineLength = 0;
+        }
+        fwrite(token.data(), 1, token.size(), file);
+        lineLength += static_cast<int>(token.size());
+    }
+
+    FILE* file;
+    int lineLength = 0;
+};
+
+// Tag of a run of `state` cells; multi-state patterns use . and A to X, with
+// a prefix p to y for every 24 states beyond
+string stateTag(const int state, const bool multiState) {
+    if (!multiState) return state == 0 ? "b" : "o";
+    if (state == 0) return ".";
+
+    const char letter = static_cast<char>('A' + (state - 1) % 24);
+    if (state <= 24) return string(1, letter);
+    return {static_cast<char>('p' + (state - 1) / 24 - 1), letter};
+}
+
+bool exportRle(const string& path, const World& world, const string& rule) {
+    // Generations worlds hold their dying states in bit planes, written as
+    // state letters like Golly does
+    Rule parsedRule;
+    vector<uint8_t> planeStates;
+    if (world.States.empty() && world.PlaneCount > 1 && parseRule(rule, parsedRule)
+        && parsedRule.family == RuleFamily::LifeLike && parsedRule.life.states > 2) {
+        planeStates.resize(static_cast<size_t>(N) * N);
+        for (int x = 0; x < N; x++) {
+            unpackGenerationsStates(world, x, planeStates.data() + static_cast<size_t>(x) * N);
+        }
+    }
+
+    const bool multiState = !world.States.empty() || !planeStates.empty();
+    const uint8_t* states = world.States.empty() ? planeStates.data() : world.States.data();
+    const auto stateAt = [&](const int x, const int y) -> int {
+        return multiState ? states[static_cast<size_t>(x) * N + y] : world.Data[x][y];
+    };
+
+    int minRow = N, maxRow = -1, minColumn = N, maxColumn = -1;
+    for (int x = 0; x < N; x++) {
+        for (int y = 0; y < N; y++) {
+            if (stateAt(x, y) == 0) continue;
+            minRow = min(minRow, x);
+            maxRow = max(maxRow, x);
+            minColumn = min(minColumn, y);
+            maxColumn = max(maxColumn, y);
+        }
+    }
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        cerr << format("Cannot create RLE file '{}'\n", path);
+        return false;
+    }
+
+    const int width = maxColumn >= minColumn ? maxColumn - minColumn + 1 : 0;
+    const int height = maxRow >= minRow ? maxRow - minRow + 1 : 0;
+
+    fputs(format("#C generation {}, top-left cell at {},{}\nx = {}, y = {}, rule = {}\n",
+        world.Generation, minColumn, minRow, width, height, rule).c_str(), file);
+
+    RleWriter writer {file};
+    int pendingRowEnds = 0;
+
+    for (int x = minRow; x <= maxRow; x++) {
+        int pendingDead = 0;
+
+        for (int y = minColumn; y <= maxColumn;) {
+            const int state = stateAt(x, y);
+            int length = 1;
+            while (y + length <= maxColumn && stateAt(x, y + length) == state) length++;
+            y += length;
+
+            if (state == 0) {
+                // Trailing dead cells of a row are implied
+                pendingDead = length;
+                continue;
+            }
+
+            writer.emit(pendingRowEnds, "$");
+            writer.emit(pendingDead, stateTag(0, multiState));
+            writer.emit(length, stateTag(state, multiState));
+            pendingRowEnds = 0;
+            pendingDead = 0;
+        }
+
+        ++pendingRowEnds;
+    }
+
+    writer.emit(1, "!");
+    fputc('\n', file);
+
+    const bool written = ferror(file) == 0;
+    fclose(file);
+
+    if (!written) {
+        cerr << format("Failed to write RLE file '{}'\n", path);
+    }
+    return written;
+}
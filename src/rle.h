@@ -0,0 +1,25 @@
+﻿#pragma once
+
+#include "world.h"
+
+#include <string>
+
+struct RlePattern {
+    int width = 0;
+    int height = 0;
+    std::string rule;
+};
+
+// Streams a Golly/LifeWiki RLE file into `world` with the pattern's top-left
+// cell at (left, top); left/top follow RLE x/y, i.e. column and row. Cells
+// outside the world wrap around like the simulation does. Only cells the
+// pattern marks alive are written, so the world should be cleared first.
+// Multi-state patterns fill World::States once a cell is above state 1.
+bool importRle(const std::string& path, World& world, int left, int top, RlePattern& pattern);
+
+// Reads just the RLE header, e.g. to centre a pattern before importing it.
+bool readRleHeader(const std::string& path, RlePattern& pattern);
+
+// Writes the bounding box of the live cells of `world` as RLE, with state
+// letters when the world holds World::States or is a Generations world.
+bool exportRle(const std::string& path, const World& world, const std::string& rule);
@@ -0,0 +1,474 @@
+﻿#include "rule.h"
+#include "rule_table.h"
+#include "world.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <format>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+// Parses the counts following a B or S, or one half of the classic form
+bool parseCounts(const string_view digits, uint16_t& mask) {
+    mask = 0;
+    for (const char digit : digits) {
+        if (digit < '0' || digit > '8') return false;
+        mask |= static_cast<uint16_t>(1u << (digit - '0'));
+    }
+    return true;
+}
+
+// States of a Generations rule, "C<n>", "G<n>" or just "<n>"
+bool parseStates(string_view text, int& states) {
+    if (!text.empty() && (toupper(static_cast<unsigned char>(text.front())) == 'C'
+                          || toupper(static_cast<unsigned char>(text.front())) == 'G')) {
+        text.remove_prefix(1);
+    }
+    if (text.empty() || text.size() > 3 || text.find_first_not_of("0123456789") != string_view::npos) return false;
+
+    states = stoi(string {text});
+    return 2 <= states && states <= MAX_RULE_STATES;
+}
+
+// Birth, survival and Generations states of a Life-like rule
+bool parseLifeCounts(string_view text, LifeRule& rule) {
+    const size_t slash = text.find('/');
+    if (slash == string_view::npos) return false;
+
+    const size_t statesSlash = text.find('/', slash + 1);
+    if (statesSlash != string_view::npos) {
+        if (!parseStates(text.substr(statesSlash + 1), rule.states)) return false;
+        text = text.substr(0, statesSlash);
+    }
+
+    string_view first = text.substr(0, slash);
+    string_view second = text.substr(slash + 1);
+
+    const auto letter = [](const string_view part) {
+        return part.empty() ? '\0' : static_cast<char>(toupper(static_cast<unsigned char>(part.front())));
+    };
+
+    // Classic notation lists survival first and has no letters
+    if (letter(first) != 'B' && letter(first) != 'S') {
+        return parseCounts(first, rule.survival) && parseCounts(second, rule.birth);
+    }
+
+    if (letter(first) == 'S') swap(first, second);
+    if (letter(first) != 'B' || letter(second) != 'S') return false;
+
+    return parseCounts(first.substr(1), rule.birth) && parseCounts(second.substr(1), rule.survival);
+}
+
+// Neighbours of a Life-like rule's shape
+int neighbourCount(const NeighbourhoodShape shape) {
+    switch (shape) {
+    case NeighbourhoodShape::VonNeumann: return 4;
+    case NeighbourhoodShape::Hexagonal: return 6;
+    default: return 8;
+    }
+}
+
+bool parseLifeRule(string_view text, LifeRule& rule) {
+    rule.states = 2;
+    rule.shape = NeighbourhoodShape::Moore;
+
+    // Golly's neighbourhood suffix ends the whole rule, Generations states included
+    if (!text.empty()) {
+        const char suffix = static_cast<char>(toupper(static_cast<unsigned char>(text.back())));
+        if (suffix == 'H' || suffix == 'V') {
+            rule.shape = suffix == 'H' ? NeighbourhoodShape::Hexagonal : NeighbourhoodShape::VonNeumann;
+            text.remove_suffix(1);
+        }
+    }
+    if (!parseLifeCounts(text, rule)) return false;
+
+    // Counts beyond the neighbours of the shape can never happen
+    return ((rule.birth | rule.survival) >> (neighbourCount(rule.shape) + 1)) == 0;
+}
+
+string formatLifeRule(const LifeRule& rule) {
+    string text = "B";
+    for (int count = 0; count <= 8; count++) {
+        if (rule.birth >> count & 1) text += static_cast<char>('0' + count);
+    }
+
+    text += "/S";
+    for (int count = 0; count <= 8; count++) {
+        if (rule.survival >> count & 1) text += static_cast<char>('0' + count);
+    }
+
+    if (rule.states > 2) {
+        text += "/C" + to_string(rule.states);
+    }
+    if (rule.shape != NeighbourhoodShape::Moore) {
+        text += rule.shape == NeighbourhoodShape::Hexagonal ? 'H' : 'V';
+    }
+    return text;
+}
+
+// Hensel letters of each neighbour count and one neighbourhood of each, in
+// the bit layout of IsotropicRule (and Golly's). Counts 5 to 8 use the
+// letters of 8 - count on the complementary neighbourhoods.
+constexpr string_view HENSEL_LETTERS[5] = {"", "ce", "ceaikn", "ceaiknjqry", "ceaiknjqrytwz"};
+constexpr int HENSEL_NEIGHBOURHOODS[5][13] = {
+    {0},
+    {1, 2},
+    {5, 10, 3, 40, 33, 68},
+    {69, 42, 11, 7, 98, 13, 14, 70, 41, 97},
+    {325, 170, 15, 45, 99, 71, 106, 102, 43, 101, 105, 78, 108},
+};
+constexpr int NEIGHBOUR_BITS = 0x1EF;
+
+string_view henselLetters(const int count) {
+    return HENSEL_LETTERS[count <= 4 ? count : 8 - count];
+}
+
+int henselNeighbourhood(const int count, const int letter) {
+    const int neighbourhood = HENSEL_NEIGHBOURHOODS[count <= 4 ? count : 8 - count][letter];
+    return count <= 4 ? neighbourhood : ~neighbourhood & NEIGHBOUR_BITS;
+}
+
+// One of the eight rotations and reflections of a 3x3 neighbourhood
+int transformNeighbourhood(const int neighbourhood, const int transform) {
+    int result = 0;
+    for (int bit = 0; bit < 9; bit++) {
+        if (!(neighbourhood >> bit & 1)) continue;
+
+        int dy = bit / 3 - 1;
+        int dx = 1 - bit % 3;
+        for (int turn = 0; turn < transform % 4; turn++) {
+            const int turned = dx;
+            dx = -dy;
+            dy = turned;
+        }
+        if (transform >= 4) dx = -dx;
+
+        result |= 1 << ((dy + 1) * 3 + 1 - dx);
+    }
+    return result;
+}
+
+int isotropicIndex(const bool alive, const int count, const int letter) {
+    return henselNeighbourhood(count, letter) | static_cast<int>(alive) << NEIGHBOURHOOD_CENTER_BIT;
+}
+
+void setIsotropicClass(IsotropicRule& rule, const bool alive, const int count, const int letter) {
+    const int index = isotropicIndex(alive, count, letter);
+    for (int transform = 0; transform < 8; transform++) {
+        const int image = transformNeighbourhood(index, transform);
+        rule.transitions[image >> 6] |= 1ull << (image & 63);
+    }
+}
+
+// Counts each followed by the letters they are limited to, or by '-' and the
+// letters they exclude, e.g. "2-a3" or "12ce"
+bool parseHenselCounts(const string_view text, const bool alive, IsotropicRule& rule) {
+    size_t i = 0;
+    while (i < text.size()) {
+        if (text[i] < '0' || text[i] > '8') return false;
+        const int count = text[i++] - '0';
+
+        const bool excluding = i < text.size() && text[i] == '-';
+        if (excluding) i++;
+
+        const size_t lettersStart = i;
+        while (i < text.size() && islower(static_cast<unsigned char>(text[i]))) i++;
+        const string_view letters = text.substr(lettersStart, i - lettersStart);
+
+        const string_view valid = henselLetters(count);
+        if (excluding && letters.empty()) return false;
+        if (letters.find_first_not_of(valid) != string_view::npos) return false;
+
+        const int classes = max<int>(1, static_cast<int>(valid.size()));
+        for (int letter = 0; letter < classes; letter++) {
+            const bool listed = !valid.empty() && letters.find(valid[letter]) != string_view::npos;
+            if (letters.empty() || listed != excluding) {
+                setIsotropicClass(rule, alive, count, letter);
+            }
+        }
+    }
+    return true;
+}
+
+bool parseIsotropicRule(const string_view text, IsotropicRule& rule) {
+    rule = {};
+
+    const size_t slash = text.find('/');
+    if (slash == string_view::npos) return false;
+
+    string_view first = text.substr(0, slash);
+    string_view second = text.substr(slash + 1);
+    if (first.empty() || second.empty()) return false;
+
+    if (toupper(static_cast<unsigned char>(first.front())) == 'S') swap(first, second);
+    if (toupper(static_cast<unsigned char>(first.front())) != 'B' || toupper(static_cast<unsigned char>(second.front())) != 'S') {
+        return false;
+    }
+
+    return parseHenselCounts(first.substr(1), false, rule) && parseHenselCounts(second.substr(1), true, rule);
+}
+
+// Each count with all its letters as a digit, with most as "-" and the
+// missing letters, otherwise followed by the letters it has
+string formatHenselCounts(const IsotropicRule& rule, const bool alive) {
+    string text;
+    for (int count = 0; count <= 8; count++) {
+        const string_view valid = henselLetters(count);
+        const int classes = max<int>(1, static_cast<int>(valid.size()));
+
+        string present;
+        string missing;
+        for (int letter = 0; letter < classes; letter++) {
+            const char name = valid.empty() ? '\0' : valid[letter];
+            (rule.next(isotropicIndex(alive, count, letter)) ? present : missing) += name;
+        }
+
+        if (present.empty()) continue;
+        text += static_cast<char>('0' + count);
+        if (missing.empty()) continue;
+        text += present.size() > missing.size() ? "-" + missing : present;
+    }
+    return text;
+}
+
+bool parseNumber(const string_view text, int& value) {
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    return error == errc {} && end == text.data() + text.size();
+}
+
+// "a..b" or a single count
+bool parseCountRange(const string_view text, int& low, int& high) {
+    const size_t dots = text.find("..");
+    if (dots == string_view::npos) {
+        return parseNumber(text, low) && parseNumber(text, high);
+    }
+    return parseNumber(text.substr(0, dots), low) && parseNumber(text.substr(dots + 2), high) && low <= high;
+}
+
+// Comma separated fields R<range>, C<states>, M<0|1>, S<range>, B<range> and
+// N<M|N>, the last three optional
+bool parseLtlRule(string_view text, LtlRule& rule) {
+    rule = {};
+    bool hasRange = false;
+    bool hasBirth = false;
+    bool hasSurvival = false;
+
+    while (!text.empty()) {
+        const size_t comma = text.find(',');
+        const string_view field = text.substr(0, comma);
+        text = comma == string_view::npos ? string_view {} : text.substr(comma + 1);
+        if (field.empty()) return false;
+
+        const string_view value = field.substr(1);
+        int number = 0;
+
+        switch (toupper(static_cast<unsigned char>(field.front()))) {
+        case 'R':
+            if (!parseNumber(value, rule.range) || rule.range < 1 || rule.range > MAX_LTL_RANGE) return false;
+            hasRange = true;
+            break;
+        case 'C':
+            // Only two-state rules, written as 0, 1 or 2 states
+            if (!parseNumber(value, number) || number > 2) return false;
+            break;
+        case 'M':
+            if (!parseNumber(value, number) || number < 0 || number > 1) return false;
+            rule.countCenter = number == 1;
+            break;
+        case 'S':
+            if (!parseCountRange(value, rule.survivalMin, rule.survivalMax)) return false;
+            hasSurvival = true;
+            break;
+        case 'B':
+            if (!parseCountRange(value, rule.birthMin, rule.birthMax)) return false;
+            hasBirth = true;
+            break;
+        case 'N':
+            if (value == "M" || value == "m") {
+                rule.shape = NeighbourhoodShape::Moore;
+            } else if (value == "N" || value == "n") {
+                rule.shape = NeighbourhoodShape::VonNeumann;
+            } else {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+
+    return hasRange && hasBirth && hasSurvival;
+}
+
+bool MargolusRule::reversible() const {
+    uint32_t seen = 0;
+    for (const uint8_t block : next) {
+        seen |= 1u << block;
+    }
+    return seen == 0xFFFF;
+}
+
+// MCell's "MS,D" followed by the 16 next blocks separated by ';'
+bool parseMargolusRule(string_view text, MargolusRule& rule) {
+    text.remove_prefix(4);
+
+    for (int block = 0; block < 16; block++) {
+        const size_t semicolon = text.find(';');
+        if ((semicolon == string_view::npos) != (block == 15)) return false;
+
+        int next = 0;
+        if (!parseNumber(text.substr(0, semicolon), next) || next < 0 || next > 15) return false;
+        rule.next[block] = static_cast<uint8_t>(next);
+        text = block == 15 ? string_view {} : text.substr(semicolon + 1);
+    }
+    return true;
+}
+
+// Bays' survival and birth ranges after the "3D": four digits, or four
+// counts separated by commas
+bool parseLife3DRule(string_view text, Life3DRule& rule) {
+    text.remove_prefix(2);
+
+    int counts[4];
+    if (text.size() == 4 && text.find_first_not_of("0123456789") == string_view::npos) {
+        for (int i = 0; i < 4; i++) {
+            counts[i] = text[i] - '0';
+        }
+    } else {
+        for (int i = 0; i < 4; i++) {
+            const size_t comma = text.find(',');
+            if ((comma == string_view::npos) != (i == 3)) return false;
+            if (!parseNumber(text.substr(0, comma), counts[i])) return false;
+            text = i == 3 ? string_view {} : text.substr(comma + 1);
+        }
+    }
+
+    rule = {counts[0], counts[1], counts[2], counts[3]};
+    return 0 <= rule.survivalMin && rule.survivalMin <= rule.survivalMax && rule.survivalMax <= LIFE_3D_NEIGHBOURS
+        && 0 <= rule.birthMin && rule.birthMin <= rule.birthMax && rule.birthMax <= LIFE_3D_NEIGHBOURS;
+}
+
+// Golly's grid suffix after the ':', e.g. "P40,30" or "K40*,40". Only the
+// kind of grid and its twisted edges matter; shifted edges are not supported.
+bool parseTopology(const string_view text, Topology& topology) {
+    if (text.empty()) return false;
+
+    const size_t comma = text.find(',');
+    const string_view width = text.substr(1, comma == string_view::npos ? string_view::npos : comma - 1);
+    const string_view height = comma == string_view::npos ? string_view {} : text.substr(comma + 1);
+
+    const auto parseSize = [](string_view size, bool& twisted) {
+        twisted = !size.empty() && size.back() == '*';
+        if (twisted) size.remove_suffix(1);
+        return all_of(size.begin(), size.end(), [](const char c) { return isdigit(static_cast<unsigned char>(c)) != 0; });
+    };
+
+    bool widthTwisted = false;
+    bool heightTwisted = false;
+    if (!parseSize(width, widthTwisted) || !parseSize(height, heightTwisted)) return false;
+
+    const bool twisted = widthTwisted || heightTwisted;
+    switch (toupper(static_cast<unsigned char>(text[0]))) {
+    case 'T':
+        topology = Topology::Torus;
+        return !twisted;
+    case 'P':
+        topology = Topology::Plane;
+        return !twisted;
+    case 'K':
+        topology = heightTwisted ? Topology::KleinBottleSides : Topology::KleinBottle;
+        return !(widthTwisted && heightTwisted);
+    case 'C':
+        topology = Topology::CrossSurface;
+        return !twisted;
+    case 'S':
+        topology = Topology::Sphere;
+        return !twisted;
+    default:
+        return false;
+    }
+}
+
+string formatTopology(const Topology topology) {
+    switch (topology) {
+    case Topology::Plane: return format(":P{},{}", N, N);
+    case Topology::KleinBottle: return format(":K{}*,{}", N, N);
+    case Topology::KleinBottleSides: return format(":K{},{}*", N, N);
+    case Topology::CrossSurface: return format(":C{},{}", N, N);
+    case Topology::Sphere: return format(":S{}", N);
+    default: return "";
+    }
+}
+
+bool parseRule(string_view text, Rule& rule) {
+    rule = {};
+
+    if (const size_t colon = text.find(':'); colon != string_view::npos) {
+        if (!parseTopology(text.substr(colon + 1), rule.topology)) return false;
+        text = text.substr(0, colon);
+    }
+
+    // Margolus rules start with MCell's "MS,D"
+    const auto upper = [](const char c) { return static_cast<char>(toupper(static_cast<unsigned char>(c))); };
+    if (text.size() > 4 && upper(text[0]) == 'M' && upper(text[1]) == 'S' && text[2] == ',' && upper(text[3]) == 'D') {
+        rule.family = RuleFamily::Margolus;
+        return parseMargolusRule(text, rule.margolus);
+    }
+
+    if (text.size() > 2 && text[0] == '3' && upper(text[1]) == 'D') {
+        rule.family = RuleFamily::Life3D;
+        return parseLife3DRule(text, rule.life3d);
+    }
+
+    // Larger than Life starts with its range, R<digits>
+    if (text.size() > 1 && toupper(static_cast<unsigned char>(text[0])) == 'R' && isdigit(static_cast<unsigned char>(text[1]))) {
+        rule.family = RuleFamily::LargerThanLife;
+        return parseLtlRule(text, rule.ltl);
+    }
+
+    if (parseLifeRule(text, rule.life)) return true;
+    rule.life = CONWAY_RULE;
+
+    if ((rule.table = findRuleTable(text)) != nullptr) {
+        rule.family = RuleFamily::Table;
+        return true;
+    }
+
+    rule.family = RuleFamily::Isotropic;
+    return parseIsotropicRule(text, rule.isotropic);
+}
+
+string formatRule(const Rule& rule) {
+    const string topology = formatTopology(rule.topology);
+
+    if (rule.family == RuleFamily::LargerThanLife) {
+        const LtlRule& ltl = rule.ltl;
+        return format("R{},C0,M{},S{}..{},B{}..{},N{}", ltl.range, ltl.countCenter ? 1 : 0,
+            ltl.survivalMin, ltl.survivalMax, ltl.birthMin, ltl.birthMax,
+            ltl.shape == NeighbourhoodShape::Moore ? 'M' : 'N') + topology;
+    }
+    if (rule.family == RuleFamily::Table) {
+        return rule.table->name + topology;
+    }
+    if (rule.family == RuleFamily::Life3D) {
+        const Life3DRule& life3d = rule.life3d;
+        if (max({life3d.survivalMin, life3d.survivalMax, life3d.birthMin, life3d.birthMax}) <= 9) {
+            return format("3D{}{}{}{}", life3d.survivalMin, life3d.survivalMax, life3d.birthMin, life3d.birthMax) + topology;
+        }
+        return format("3D{},{},{},{}", life3d.survivalMin, life3d.survivalMax, life3d.birthMin, life3d.birthMax) + topology;
+    }
+    if (rule.family == RuleFamily::Margolus) {
+        string text = "MS,D";
+        for (int block = 0; block < 16; block++) {
+            text += (block > 0 ? ";" : "") + to_string(rule.margolus.next[block]);
+        }
+        return text + topology;
+    }
+    if (rule.family == RuleFamily::Isotropic) {
+        return "B" + formatHenselCounts(rule.isotropic, false) + "/S" + formatHenselCounts(rule.isotropic, true) + topology;
+    }
+    return formatLifeRule(rule.life) + topology;
+}
@@ -0,0 +1,161 @@
+﻿#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+enum class NeighbourhoodShape {
+    Moore,       // the (2r + 1) x (2r + 1) square
+    VonNeumann,  // the diamond |dx| + |dy| <= r
+    Hexagonal,   // Life-like rules only, Golly's hex grid: Moore without the NE and SW
+                 // cells, as if each row sat half a cell west of the one above
+};
+
+// Life-like (outer totalistic) rule: bit n of `birth` makes a dead cell with n
+// live neighbours come alive, bit n of `survival` keeps a live one alive.
+//
+// With more than two states it is a Generations rule: a live cell that does
+// not survive passes through the dying states 2 .. states - 1, one per
+// generation, before it is dead again. Only live cells count as neighbours,
+// and dying cells can't be born.
+//
+// The neighbours are the Moore neighbourhood by default, or the 4 cells of the
+// von Neumann one or the 6 of a hexagonal grid (see NeighbourhoodShape).
+struct LifeRule {
+    uint16_t birth = 0;
+    uint16_t survival = 0;
+    int states = 2;
+    NeighbourhoodShape shape = NeighbourhoodShape::Moore;
+
+    bool operator==(const LifeRule&) const = default;
+};
+
+// Neighbour counts "0".."8" as a mask, e.g. countMask("23") == 0b1100
+constexpr uint16_t countMask(const std::string_view digits) {
+    uint16_t mask = 0;
+    for (const char digit : digits) {
+        mask |= static_cast<uint16_t>(1u << (digit - '0'));
+    }
+    return mask;
+}
+
+constexpr char DEFAULT_RULE[] = "B3/S23";
+constexpr LifeRule CONWAY_RULE {countMask("3"), countMask("23"), 2};
+constexpr int MAX_RULE_STATES = 256;
+
+// Larger than Life: two-state rule on the cells within `range` of a cell,
+// the cell itself included when `countCenter` is set. Births and survivals
+// are ranges of live counts.
+struct LtlRule {
+    int range = 1;
+    bool countCenter = false;
+    NeighbourhoodShape shape = NeighbourhoodShape::Moore;
+    int birthMin = 0;
+    int birthMax = 0;
+    int survivalMin = 0;
+    int survivalMax = 0;
+
+    bool operator==(const LtlRule&) const = default;
+};
+
+constexpr int MAX_LTL_RANGE = 500;
+
+// Isotropic non-totalistic rule, as a table of the next state of every 3x3
+// neighbourhood. Bit i of the index is the cell in row i / 3 and column
+// 2 - i % 3 of the neighbourhood (bit 4 the cell itself), so the index of the
+// next cell along a row is the previous one shifted left by one column.
+struct IsotropicRule {
+    std::array<uint64_t, 8> transitions {};  // bit i % 64 of word i / 64
+
+    bool next(const int neighbourhood) const { return transitions[neighbourhood >> 6] >> (neighbourhood & 63) & 1; }
+
+    bool operator==(const IsotropicRule&) const = default;
+};
+
+constexpr int NEIGHBOURHOOD_CENTER_BIT = 4;
+
+// Margolus block rule: the world is split into 2x2 blocks, aligned with the
+// origin on even generations and a cell down and right on odd ones, and each
+// block is replaced by next[block]. The cells of a block are bit 1 upper
+// left, 2 upper right, 4 lower left and 8 lower right, as in MCell.
+struct MargolusRule {
+    std::array<uint8_t, 16> next {};
+
+    // A permutation of the blocks, which can be undone block by block
+    bool reversible() const;
+
+    bool operator==(const MargolusRule&) const = default;
+};
+
+// 3D outer-totalistic rule in Bays' notation: a live cell survives with
+// survivalMin to survivalMax of its 26 neighbours alive, a dead one is born
+// with birthMin to birthMax. Life 4555 is the default.
+struct Life3DRule {
+    int survivalMin = 4;
+    int survivalMax = 5;
+    int birthMin = 5;
+    int birthMax = 5;
+
+    bool operator==(const Life3DRule&) const = default;
+};
+
+constexpr int LIFE_3D_NEIGHBOURS = 26;
+
+// How the edges of the world are joined, Golly's bounded grids
+enum class Topology {
+    Torus,             // opposite edges joined (T)
+    Plane,             // no cells beyond the edges (P)
+    KleinBottle,       // left and right joined, top and bottom joined with a twist (K<w>*,<h>)
+    KleinBottleSides,  // top and bottom joined, left and right joined with a twist (K<w>,<h>*)
+    CrossSurface,      // both pairs of edges joined with a twist (C)
+    Sphere,            // top edge joined to the left edge, bottom edge to the right (S)
+};
+
+// Multi-state rule table, see rule_table.h
+struct RuleTable;
+
+enum class RuleFamily {
+    LifeLike,        // including Generations
+    LargerThanLife,
+    Isotropic,
+    Table,
+    Margolus,
+    Life3D,
+};
+
+// Any rule the simulation runs; only the member of `family` is meaningful.
+struct Rule {
+    RuleFamily family = RuleFamily::LifeLike;
+    LifeRule life = CONWAY_RULE;
+    LtlRule ltl;
+    IsotropicRule isotropic;
+    MargolusRule margolus;
+    Life3DRule life3d;
+    std::shared_ptr<const RuleTable> table;
+    Topology topology = Topology::Torus;
+
+    bool operator==(const Rule&) const = default;
+};
+
+// Accepts B/S notation ("B36/S23", either order, any case) and the classic
+// survival/birth form ("23/36"), each optionally followed by the number of
+// states of a Generations rule ("B2/S/C3", "/2/3") and by H or V for the
+// hexagonal or von Neumann neighbourhood ("B2/S34H", "B2/S/C3V"); isotropic
+// rules in Hensel notation ("B2-a/S12", "B3/S23-q4ce"), Larger than Life
+// rules as Golly writes them ("R5,C0,M1,S34..58,B34..45,NM"), Margolus rules
+// as MCell does ("MS,D0;8;4;3;2;5;9;7;1;6;10;11;12;13;14;15"), 3D rules as
+// "3D" and Bays' four counts ("3D4555", "3D5,7,6,6"), or the name of
+// a rule table (built in or loaded, see rule_table.h). A Golly grid suffix
+// (":P", ":K40*,40", ":S") sets the topology; its sizes are not checked, the
+// world keeps its own.
+bool parseRule(std::string_view text, Rule& rule);
+
+// B/S notation, counts in ascending order, with /C<states> for Generations,
+// H or V for other neighbourhoods and the letters of isotropic rules; Golly's
+// notation for Larger than Life; the name of a rule table; MCell's for
+// Margolus rules; "3D" and Bays' counts for 3D rules, comma separated once
+// one is above 9. Topologies other than the torus add a grid suffix of the
+// current size N.
+std::string formatRule(const Rule& rule);
@@ -0,0 +1,459 @@
+﻿#include "rule_table.h"
+
+#include <algorithm>
+#include <bit>
+#include <bitset>
+#include <cctype>
+#include <charconv>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+using namespace std;
+
+using StateSet = bitset<MAX_RULE_STATES>;
+
+uint8_t RuleTable::next(const uint8_t* cells) const {
+    const int count = cellCount();
+
+    for (int word = 0; word < matchWords; word++) {
+        uint64_t matches = ~0ull;
+        for (int cell = 0; cell < count; cell++) {
+            matches &= matchBits[(static_cast<size_t>(cell) * states + cells[cell]) * matchWords + word];
+        }
+        if (matches != 0) return outputs[word * 64 + countr_zero(matches)];
+    }
+    return cells[0];
+}
+
+string_view trimTableText(string_view text) {
+    while (!text.empty() && isspace(static_cast<unsigned char>(text.front()))) text.remove_prefix(1);
+    while (!text.empty() && isspace(static_cast<unsigned char>(text.back()))) text.remove_suffix(1);
+    return text;
+}
+
+string lowercase(const string_view text) {
+    string lower {text};
+    for (char& c : lower) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    return lower;
+}
+
+bool parseTableNumber(const string_view text, int& value) {
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    return error == errc {} && end == text.data() + text.size();
+}
+
+// Splits "a,{1,2},3" at the commas outside braces
+vector<string_view> splitTableList(const string_view text) {
+    vector<string_view> items;
+    int depth = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= text.size(); i++) {
+        if (i == text.size() || (text[i] == ',' && depth == 0)) {
+            items.push_back(trimTableText(text.substr(start, i - start)));
+            start = i + 1;
+        } else if (text[i] == '{') {
+            depth++;
+        } else if (text[i] == '}') {
+            depth--;
+        }
+    }
+    return items;
+}
+
+// Ways a transition's neighbours may be rearranged, as neighbour orders:
+// entry i of a permutation is the neighbour that moves to position i.
+bool symmetryPermutations(const string_view symmetries, const int ringSize, vector<vector<int>>& permutations) {
+    const bool moore = ringSize == 8;
+    int rotationStep = 0;
+    bool reflect = false;
+
+    if (symmetries == "none") {
+        rotationStep = ringSize;
+    } else if (symmetries == "rotate4") {
+        rotationStep = ringSize / 4;
+    } else if (symmetries == "rotate8" && moore) {
+        rotationStep = 1;
+    } else if (symmetries == "reflect" || symmetries == "reflect_horizontal") {
+        rotationStep = ringSize;
+        reflect = true;
+    } else if (symmetries == "rotate4reflect") {
+        rotationStep = ringSize / 4;
+        reflect = true;
+    } else if (symmetries == "rotate8reflect" && moore) {
+        rotationStep = 1;
+        reflect = true;
+    } else {
+        return false;
+    }
+
+    permutations.clear();
+    for (int mirrored = 0; mirrored <= (reflect ? 1 : 0); mirrored++) {
+        for (int rotation = 0; rotation < ringSize; rotation += rotationStep) {
+            vector<int>& permutation = permutations.emplace_back(ringSize);
+            for (int i = 0; i < ringSize; i++) {
+                // Mirroring left and right keeps N in place
+                const int source = mirrored ? (ringSize - i) % ringSize : i;
+                permutation[i] = (source + rotation) % ringSize;
+            }
+        }
+    }
+    return true;
+}
+
+struct TableParser {
+    TableParser(RuleTable& table, string& error) : table(table), error(error) {}
+
+    RuleTable& table;
+    string& error;
+
+    string symmetries = "none";
+    bool sawStates = false;
+    map<string, StateSet, less<>> variables;
+    vector<array<StateSet, MAX_TABLE_CELLS>> inputs;
+
+    bool fail(const string& message) {
+        error = message;
+        return false;
+    }
+
+    bool parseState(const string_view text, int& state) {
+        return parseTableNumber(text, state) && 0 <= state && state < table.states;
+    }
+
+    // A state, a variable or a {list} of them
+    bool parseStateSet(const string_view text, StateSet& set) {
+        if (text.size() >= 2 && text.front() == '{' && text.back() == '}') {
+            set.reset();
+            for (const string_view item : splitTableList(text.substr(1, text.size() - 2))) {
+                StateSet itemSet;
+                if (!parseStateSet(item, itemSet)) return false;
+                set |= itemSet;
+            }
+            return true;
+        }
+
+        if (const auto variable = variables.find(text); variable != variables.end()) {
+            set = variable->second;
+            return true;
+        }
+
+        int state = 0;
+        if (!parseState(text, state)) return false;
+        set.reset();
+        set.set(state);
+        return true;
+    }
+
+    bool parseSetting(const string_view key, const string_view value) {
+        if (key == "n_states") {
+            if (!parseTableNumber(value, table.states) || table.states < 2 || table.states > MAX_RULE_STATES) {
+                return fail(format("n_states must be 2 to {}", MAX_RULE_STATES));
+            }
+            sawStates = true;
+        } else if (key == "neighborhood") {
+            const string shape = lowercase(value);
+            if (shape == "moore") {
+                table.shape = NeighbourhoodShape::Moore;
+            } else if (shape == "vonneumann") {
+                table.shape = NeighbourhoodShape::VonNeumann;
+            } else {
+                return fail(format("neighborhood {} is not supported, only Moore and vonNeumann", value));
+            }
+        } else if (key == "symmetries") {
+            symmetries = lowercase(value);
+        } else {
+            return fail(format("unknown setting {}", key));
+        }
+        return true;
+    }
+
+    bool parseVariable(const string_view line) {
+        const size_t equals = line.find('=');
+        if (equals == string_view::npos) return fail(format("expected var <name>={{...}}: {}", line));
+
+        const string_view name = trimTableText(line.substr(3, equals - 3));
+        StateSet set;
+        if (name.empty() || !parseStateSet(trimTableText(line.substr(equals + 1)), set)) {
+            return fail(format("bad variable: {}", line));
+        }
+        variables.insert_or_assign(string(name), set);
+        return true;
+    }
+
+    void addTransition(const array<StateSet, MAX_TABLE_CELLS>& cells, const int output,
+                       const vector<vector<int>>& permutations) {
+        const int ringSize = table.cellCount() - 1;
+
+        if (table.permute) {
+            // Every distinct arrangement of the neighbour sets
+            vector<StateSet> distinct;
+            vector<int> order(ringSize);
+            for (int i = 0; i < ringSize; i++) {
+                const StateSet& set = cells[1 + i];
+                const auto known = find(distinct.begin(), distinct.end(), set);
+                order[i] = static_cast<int>(known - distinct.begin());
+                if (known == distinct.end()) distinct.push_back(set);
+            }
+            sort(order.begin(), order.end());
+
+            do {
+                array<StateSet, MAX_TABLE_CELLS>& arranged = inputs.emplace_back();
+                arranged[0] = cells[0];
+                for (int i = 0; i < ringSize; i++) arranged[1 + i] = distinct[order[i]];
+                table.outputs.push_back(static_cast<uint8_t>(output));
+            } while (next_permutation(order.begin(), order.end()));
+            return;
+        }
+
+        for (const vector<int>& permutation : permutations) {
+            array<StateSet, MAX_TABLE_CELLS>& arranged = inputs.emplace_back();
+            arranged[0] = cells[0];
+            for (int i = 0; i < ringSize; i++) arranged[1 + i] = cells[1 + permutation[i]];
+            table.outputs.push_back(static_cast<uint8_t>(output));
+        }
+    }
+
+    bool parseTransition(const string_view line, const vector<vector<int>>& permutations) {
+        vector<string_view> tokens;
+        if (line.find(',') == string_view::npos) {
+            // Compact form, one digit per cell
+            for (size_t i = 0; i < line.size(); i++) {
+                if (!isspace(static_cast<unsigned char>(line[i]))) tokens.push_back(line.substr(i, 1));
+            }
+        } else {
+            tokens = splitTableList(line);
+        }
+
+        const int cellCount = table.cellCount();
+        if (static_cast<int>(tokens.size()) != cellCount + 1) {
+            return fail(format("expected {} entries: {}", cellCount + 1, line));
+        }
+
+        // Variables used more than once are bound: all their uses take the same state
+        vector<string_view> bound;
+        for (const string_view token : tokens) {
+            if (!variables.contains(token) || find(bound.begin(), bound.end(), token) != bound.end()) continue;
+            if (count(tokens.begin(), tokens.end(), token) > 1) bound.push_back(token);
+        }
+
+        array<StateSet, MAX_TABLE_CELLS> cells;
+        for (int cell = 0; cell < cellCount; cell++) {
+            if (!parseStateSet(tokens[cell], cells[cell])) return fail(format("bad entry {}: {}", tokens[cell], line));
+        }
+
+        const string_view outputToken = tokens[cellCount];
+        int output = 0;
+        const auto outputVariable = find(bound.begin(), bound.end(), outputToken);
+        if (outputVariable == bound.end() && !parseState(outputToken, output)) {
+            return fail(format("the new state must be a state or a variable bound in the inputs: {}", line));
+        }
+
+        // Every combination of states of the bound variables
+        vector<int> values(bound.size(), 0);
+        const auto assign = [&](auto& self, const size_t variable) -> void {
+            if (variable == bound.size()) {
+                array<StateSet, MAX_TABLE_CELLS> assigned = cells;
+                for (int cell = 0; cell < cellCount; cell++) {
+                    const auto b = find(bound.begin(), bound.end(), tokens[cell]);
+                    if (b == bound.end()) continue;
+                    assigned[cell].reset();
+                    assigned[cell].set(values[b - bound.begin()]);
+                }
+                const int next = outputVariable == bound.end() ? output : values[outputVariable - bound.begin()];
+                addTransition(assigned, next, permutations);
+                return;
+            }
+
+            const StateSet& set = variables.find(bound[variable])->second;
+            for (int state = 0; state < table.states; state++) {
+                if (!set.test(state)) continue;
+                values[variable] = state;
+                self(self, variable + 1);
+            }
+        };
+        assign(assign, 0);
+        return true;
+    }
+
+    bool parseColor(const string_view line) {
+        vector<int> numbers;
+        istringstream stream {string(line)};
+        for (int number; stream >> number;) numbers.push_back(number);
+        if (!stream.eof()) return fail(format("bad colour line: {}", line));
+
+        const auto setColor = [&](const int state, const int r, const int g, const int b) {
+            if (state < 0 || state >= table.states) return;
+            table.colors[state] = {static_cast<uint8_t>(r), static_cast<uint8_t>(g), static_cast<uint8_t>(b), true};
+        };
+
+        if (numbers.size() == 4) {
+            setColor(numbers[0], numbers[1], numbers[2], numbers[3]);
+        } else if (numbers.size() == 6) {
+            // A gradient over the live states
+            for (int state = 1; state < table.states; state++) {
+                const float f = table.states > 2 ? static_cast<float>(state - 1) / static_cast<float>(table.states - 2) : 0.f;
+                const auto mix = [f](const int a, const int b) { return static_cast<int>(a + (b - a) * f); };
+                setColor(state, mix(numbers[0], numbers[3]), mix(numbers[1], numbers[4]), mix(numbers[2], numbers[5]));
+            }
+        } else {
+            return fail(format("bad colour line: {}", line));
+        }
+        return true;
+    }
+
+    void compile() {
+        const int cellCount = table.cellCount();
+        const size_t transitions = table.outputs.size();
+        table.matchWords = static_cast<int>((transitions + 63) / 64);
+        table.matchBits.assign(static_cast<size_t>(cellCount) * table.states * table.matchWords, 0);
+
+        for (size_t t = 0; t < transitions; t++) {
+            for (int cell = 0; cell < cellCount; cell++) {
+                for (int state = 0; state < table.states; state++) {
+                    if (!inputs[t][cell].test(state)) continue;
+                    table.matchBits[(static_cast<size_t>(cell) * table.states + state) * table.matchWords + t / 64]
+                        |= 1ull << (t % 64);
+                }
+            }
+        }
+        inputs.clear();
+    }
+};
+
+bool parseRuleTable(const string_view text, RuleTable& table, string& error) {
+    table = {};
+    TableParser parser {table, error};
+
+    string section;
+    bool sawTable = false;
+    vector<vector<int>> permutations;
+    bool transitionsStarted = false;
+
+    istringstream lines {string(text)};
+    for (string rawLine; getline(lines, rawLine);) {
+        string_view line = rawLine;
+        if (const size_t comment = line.find('#'); comment != string_view::npos) line = line.substr(0, comment);
+        line = trimTableText(line);
+        if (line.empty()) continue;
+
+        if (line.front() == '@') {
+            const size_t space = line.find_first_of(" \t");
+            section = line.substr(0, space);
+            if (section == "@RULE" && space != string_view::npos) {
+                table.name = trimTableText(line.substr(space));
+            } else if (section == "@TABLE") {
+                sawTable = true;
+            } else if (section == "@TREE") {
+                error = "only @TABLE rules are supported, not @TREE";
+                return false;
+            }
+            continue;
+        }
+
+        if (section == "@COLORS") {
+            if (table.colors.empty()) table.colors.resize(table.states);
+            if (!parser.parseColor(line)) return false;
+            continue;
+        }
+        if (section != "@TABLE") continue;
+
+        if (const size_t colon = line.find(':'); colon != string_view::npos) {
+            if (transitionsStarted) return parser.fail(format("setting after the transitions: {}", line));
+            if (!parser.parseSetting(trimTableText(line.substr(0, colon)), trimTableText(line.substr(colon + 1)))) return false;
+        } else if (line.starts_with("var ") || line.starts_with("var\t")) {
+            if (!parser.parseVariable(line)) return false;
+        } else {
+            if (!transitionsStarted) {
+                if (!parser.sawStates) return parser.fail("n_states must come before the transitions");
+                table.permute = parser.symmetries == "permute";
+                if (!table.permute && !symmetryPermutations(parser.symmetries, table.cellCount() - 1, permutations)) {
+                    return parser.fail(format("symmetries {} is not supported here", parser.symmetries));
+                }
+                transitionsStarted = true;
+            }
+            if (!parser.parseTransition(line, permutations)) return false;
+        }
+    }
+
+    if (table.name.empty()) return parser.fail("missing @RULE name");
+    if (!sawTable) return parser.fail("missing @TABLE");
+
+    table.colors.resize(table.states);
+    parser.compile();
+    return true;
+}
+
+// Golly's WireWorld: heads become tails, tails conductors, and conductors
+// with one or two head neighbours become heads.
+constexpr char WIREWORLD_RULE[] = R"(@RULE WireWorld
+@TABLE
+n_states:4
+neighborhood:Moore
+symmetries:permute
+var a={0,1,2,3}
+var b={0,1,2,3}
+var c={0,1,2,3}
+var d={0,1,2,3}
+var e={0,1,2,3}
+var f={0,1,2,3}
+var g={0,1,2,3}
+var h={0,1,2,3}
+var o={0,2,3}
+var p={0,2,3}
+var q={0,2,3}
+var r={0,2,3}
+var s={0,2,3}
+var t={0,2,3}
+var u={0,2,3}
+1,a,b,c,d,e,f,g,h,2
+2,a,b,c,d,e,f,g,h,3
+3,1,o,p,q,r,s,t,u,1
+3,1,1,o,p,q,r,s,t,1
+@COLORS
+1 0 128 255
+2 255 255 255
+3 255 128 0
+)";
+
+// Tables by lowercase name
+map<string, shared_ptr<const RuleTable>, less<>>& ruleTables() {
+    static map<string, shared_ptr<const RuleTable>, less<>> tables = [] {
+        map<string, shared_ptr<const RuleTable>, less<>> builtIn;
+        auto wireworld = make_shared<RuleTable>();
+        string error;
+        parseRuleTable(WIREWORLD_RULE, *wireworld, error);
+        builtIn.emplace(lowercase(wireworld->name), std::move(wireworld));
+        return builtIn;
+    }();
+    return tables;
+}
+
+bool loadRuleTable(const string& path) {
+    ifstream file {path};
+    if (!file) {
+        cerr << format("Cannot open rule file '{}'\n", path);
+        return false;
+    }
+
+    ostringstream text;
+    text << file.rdbuf();
+
+    auto table = make_shared<RuleTable>();
+    string error;
+    if (!parseRuleTable(text.str(), *table, error)) {
+        cerr << format("Rule file '{}': {}\n", path, error);
+        return false;
+    }
+
+    ruleTables().insert_or_assign(lowercase(table->name), std::move(table));
+    return true;
+}
+
+shared_ptr<const RuleTable> findRuleTable(const string_view name) {
+    const auto& tables = ruleTables();
+    const auto table = tables.find(lowercase(name));
+    return table == tables.end() ? nullptr : table->second;
+}
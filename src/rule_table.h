@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include "rule.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Cells of a neighbourhood in Golly's rule table order: the cell itself, then
+// N, NE, E, SE, S, SW, W, NW (Moore) or N, E, S, W (von Neumann).
+constexpr int MAX_TABLE_CELLS = 9;
+
+// Multi-state rule from the @TABLE section of a Golly .rule file. The first
+// transition matching a cell and its neighbours gives the cell's next state;
+// without a match the cell keeps its state.
+struct RuleTable {
+    std::string name;
+    int states = 2;
+    NeighbourhoodShape shape = NeighbourhoodShape::Moore;
+    bool permute = false;  // symmetries:permute, the next state only depends on neighbour counts
+
+    // Transitions with variables and symmetries expanded, compiled to one bit
+    // per transition for every (cell, state): the transitions a
+    // neighbourhood matches are the AND of the bits of its cells.
+    std::vector<uint8_t> outputs;
+    std::vector<uint64_t> matchBits;  // [cell][state][word]
+    int matchWords = 0;
+
+    // @COLORS, by state; unset states use the usual palette
+    struct StateColor {
+        uint8_t r = 0;
+        uint8_t g = 0;
+        uint8_t b = 0;
+        bool given = false;
+    };
+    std::vector<StateColor> colors;
+
+    int cellCount() const { return shape == NeighbourhoodShape::Moore ? 9 : 5; }
+
+    // Next state of the neighbourhood `cells`, in table order
+    uint8_t next(const uint8_t* cells) const;
+};
+
+// Parses the text of a .rule file: @RULE names the table, @TABLE holds it
+// (n_states, neighborhood Moore or vonNeumann, symmetries, var lines and
+// transitions, variables used more than once in a transition being bound),
+// @COLORS is optional and other sections are ignored.
+bool parseRuleTable(std::string_view text, RuleTable& table, std::string& error);
+
+// Reads a .rule file and makes its table known to parseRule by its name.
+bool loadRuleTable(const std::string& path);
+
+// Table named `name`, any case, loaded or built in (WireWorld); null if none.
+std::shared_ptr<const RuleTable> findRuleTable(std::string_view name);
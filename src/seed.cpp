@@ -0,0 +1,36 @@
+﻿#include "seed.h"
+#include "sim.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+uint64_t seedKey(const uint64_t seed) {
+    return mixBits(seed + 0x9E3779B97F4A7C15ull);
+}
+
+uint64_t seedThreshold(const float density) {
+    // Compared against the top 32 bits of the cell hash
+    return static_cast<uint64_t>(llround(clamp(static_cast<double>(density), 0.0, 1.0) * 4294967296.0));
+}
+
+void seedWorld(World& world, const SeedSettings& settings) {
+    const int left = clamp(settings.left, 0, N);
+    const int top = clamp(settings.top, 0, N);
+    const int right = settings.width > 0 ? min(N, left + settings.width) : N;
+    const int bottom = settings.height > 0 ? min(N, top + settings.height) : N;
+    if (left >= right || top >= bottom) return;
+
+    const uint64_t key = seedKey(settings.seed);
+    const uint64_t threshold = seedThreshold(settings.density);
+
+    // Data is indexed [row][column], rows are split between the sim workers
+    runOnSimWorkers(bottom - top, [&world, key, threshold, top, left, right](const int first, const int last) {
+        for (int row = top + first; row < top + last; row++) {
+            for (int column = left; column < right; column++) {
+                world.Data[row][column] = seedCell(key, threshold, column, row);
+            }
+        }
+    });
+}
@@ -0,0 +1,46 @@
+﻿#pragma once
+
+#include "world.h"
+
+#include <cstdint>
+
+struct SeedSettings {
+    uint64_t seed = 1;
+    float density = 0.4f;  // probability of a live cell
+
+    // Region filled with noise, the rest of the world is left as is.
+    // A zero width or height extends the region to the world edge.
+    int left = 0;
+    int top = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// Counter-based generator: the state of a cell is a pure function of the seed
+// and its position, so worlds are bit-identical for a seed whatever the
+// platform, thread count or fill order, and any part can be seeded alone.
+uint64_t seedKey(uint64_t seed);
+uint64_t seedThreshold(float density);
+
+inline uint64_t mixBits(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+inline bool seedCell(const uint64_t key, const uint64_t threshold, const uint64_t x, const uint64_t y) {
+    const uint64_t counter = (y << 32) | (x & 0xFFFFFFFFull);
+    return (mixBits(key + counter * 0x9E3779B97F4A7C15ull) >> 32) < threshold;
+}
+
+// Cells x .. x + 63 of row y, packed LSB first as in bitpack.h
+inline uint64_t seedWord(const uint64_t key, const uint64_t threshold, const uint64_t x, const uint64_t y) {
+    uint64_t word = 0;
+    for (int b = 0; b < 64; b++) {
+        word |= static_cast<uint64_t>(seedCell(key, threshold, x + b, y)) << b;
+    }
+    return word;
+}
+
+// Fills the region of `world` on the sim workers, between runs.
+void seedWorld(World& world, const SeedSettings& settings);
@@ -0,0 +1,77 @@
+﻿#include "shared_export.h"
+#include "shared_world.h"
+#include "world.h"
+
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <new>
+
+using namespace std;
+
+static_assert(SHARED_WORLD_SLOTS == 3, "one slot per world buffer");
+static_assert(sizeof(bool) == 1, "slots expose World::Data as bytes");
+
+SharedMemory sharedSegment;
+SharedWorldHeader* sharedHeader = nullptr;
+
+bool startSharedWorldExport(const string& name) {
+    if (name.empty()) return true;
+
+    const size_t segmentSize = SHARED_WORLD_HEADER_SIZE + SHARED_WORLD_SLOTS * World::storageSize(N);
+    if (!sharedSegment.create(name, segmentSize)) {
+        cerr << format("Cannot create shared memory segment '{}'\n", name);
+        return false;
+    }
+
+    SharedWorldHeader* header = new (sharedSegment.data) SharedWorldHeader {};
+    memcpy(header->magic, SHARED_WORLD_MAGIC, sizeof(SHARED_WORLD_MAGIC));
+    header->version = SHARED_WORLD_VERSION;
+    header->width = N;
+    header->height = N;
+    header->rowStride = N;
+    header->slotOffset = SHARED_WORLD_HEADER_SIZE;
+    header->slotStride = World::storageSize(N);
+
+    for (int i = 0; i < SHARED_WORLD_SLOTS; i++) {
+        worlds[i].place(N, sharedSegment.data + header->slotOffset + i * header->slotStride);
+    }
+
+    header->running.store(1, memory_order_release);
+    sharedHeader = header;
+    return true;
+}
+
+void sharedWorldBeginWrite(const int index) {
+    if (sharedHeader == nullptr) return;
+
+    SharedWorldSlot& slot = sharedHeader->slots[index];
+    const uint64_t sequence = slot.sequence.load(memory_order_relaxed);
+    if (sequence & 1) return;
+
+    slot.sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void sharedWorldPublish(const int index, const int generation) {
+    if (sharedHeader == nullptr) return;
+
+    SharedWorldSlot& slot = sharedHeader->slots[index];
+    slot.generation.store(generation, memory_order_relaxed);
+    slot.sequence.store((slot.sequence.load(memory_order_relaxed) | 1) + 1, memory_order_release);
+
+    const uint64_t sequence = sharedHeader->sequence.load(memory_order_relaxed);
+    sharedHeader->sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    sharedHeader->latestSlot.store(index, memory_order_relaxed);
+    sharedHeader->latestGeneration.store(generation, memory_order_relaxed);
+    sharedHeader->sequence.store(sequence + 2, memory_order_release);
+}
+
+void stopSharedWorldExport() {
+    if (sharedHeader == nullptr) return;
+
+    sharedHeader->running.store(0, memory_order_release);
+    sharedSegment.unlink();
+}
@@ -0,0 +1,21 @@
+﻿#pragma once
+
+#include <string>
+
+// Publishing of the world buffers through a shared-memory segment, see
+// shared_world.h for the layout and the reader side.
+
+// Moves the triple buffer into the segment `name`, so the sim computes
+// straight into shared memory. Must run after resizeWorlds and before the
+// worlds are initialized.
+bool startSharedWorldExport(const std::string& name);
+
+// Called by the sim thread around writing a generation into worlds[index]:
+// readers holding that slot see it invalidated, then the new generation
+// becomes the latest.
+void sharedWorldBeginWrite(int index);
+void sharedWorldPublish(int index, int generation);
+
+// Tells readers the engine is done and removes the segment's name. The
+// mapping itself stays until exit, the worlds still live in it.
+void stopSharedWorldExport();
@@ -0,0 +1,177 @@
+﻿#include "shared_world.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+
+using namespace std;
+
+#ifdef _WIN32
+
+bool SharedMemory::create(const string& name, const size_t segmentSize) {
+    close();
+
+    systemName = "Local\\" + name;
+    const uint64_t size64 = segmentSize;
+    mappingHandle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(size64 >> 32), static_cast<DWORD>(size64), systemName.c_str());
+    if (mappingHandle == nullptr) return false;
+
+    data = static_cast<uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_WRITE, 0, 0, segmentSize));
+    if (data == nullptr) {
+        close();
+        return false;
+    }
+    size = segmentSize;
+
+    // A segment left by an earlier run that is still open elsewhere keeps its contents
+    memset(data, 0, size);
+    return true;
+}
+
+bool SharedMemory::open(const string& name) {
+    close();
+
+    systemName = "Local\\" + name;
+    mappingHandle = OpenFileMappingA(FILE_MAP_READ, FALSE, systemName.c_str());
+    if (mappingHandle == nullptr) return false;
+
+    data = static_cast<uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (data == nullptr) {
+        close();
+        return false;
+    }
+
+    MEMORY_BASIC_INFORMATION info;
+    VirtualQuery(data, &info, sizeof(info));
+    size = info.RegionSize;
+    return true;
+}
+
+// Named mappings disappear with their last handle
+void SharedMemory::unlink() {}
+
+void SharedMemory::close() {
+    if (data != nullptr) UnmapViewOfFile(data);
+    if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+
+    data = nullptr;
+    size = 0;
+    mappingHandle = nullptr;
+}
+
+#else
+
+bool SharedMemory::create(const string& name, const size_t segmentSize) {
+    close();
+
+    systemName = "/" + name;
+    shm_unlink(systemName.c_str());
+
+    const int fd = shm_open(systemName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) return false;
+
+    if (ftruncate(fd, static_cast<off_t>(segmentSize)) != 0) {
+        ::close(fd);
+        unlink();
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        unlink();
+        return false;
+    }
+
+    data = static_cast<uint8_t*>(mapping);
+    size = segmentSize;
+    return true;
+}
+
+bool SharedMemory::open(const string& name) {
+    close();
+
+    systemName = "/" + name;
+    const int fd = shm_open(systemName.c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+
+    struct stat segmentStat {};
+    if (fstat(fd, &segmentStat) != 0 || segmentStat.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, static_cast<size_t>(segmentStat.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    data = static_cast<uint8_t*>(mapping);
+    size = static_cast<size_t>(segmentStat.st_size);
+    return true;
+}
+
+void SharedMemory::unlink() {
+    if (!systemName.empty()) shm_unlink(systemName.c_str());
+}
+
+void SharedMemory::close() {
+    if (data != nullptr) munmap(data, size);
+
+    data = nullptr;
+    size = 0;
+}
+
+#endif
+
+bool SharedWorldReader::open(const string& name) {
+    header = nullptr;
+    if (!memory.open(name)) return false;
+
+    const auto* candidate = reinterpret_cast<const SharedWorldHeader*>(memory.data);
+    if (memory.size < SHARED_WORLD_HEADER_SIZE
+        || memcmp(candidate->magic, SHARED_WORLD_MAGIC, sizeof(SHARED_WORLD_MAGIC)) != 0
+        || candidate->version != SHARED_WORLD_VERSION
+        || candidate->slotOffset + SHARED_WORLD_SLOTS * candidate->slotStride > memory.size) {
+        memory.close();
+        return false;
+    }
+
+    header = candidate;
+    return true;
+}
+
+bool SharedWorldReader::acquireLatest(SharedWorldFrame& frame) const {
+    const uint64_t headerSequence = header->sequence.load(memory_order_acquire);
+    if (headerSequence & 1) return false;
+
+    const uint32_t slot = header->latestSlot.load(memory_order_relaxed);
+    const int64_t generation = header->latestGeneration.load(memory_order_relaxed);
+
+    atomic_thread_fence(memory_order_acquire);
+    if (header->sequence.load(memory_order_relaxed) != headerSequence || slot >= SHARED_WORLD_SLOTS) return false;
+
+    const uint64_t slotSequence = header->slots[slot].sequence.load(memory_order_acquire);
+    if ((slotSequence & 1) || header->slots[slot].generation.load(memory_order_relaxed) != generation) return false;
+
+    frame.cells = memory.data + header->slotOffset + slot * header->slotStride;
+    frame.generation = generation;
+    frame.slot = static_cast<int>(slot);
+    frame.sequence = slotSequence;
+    return true;
+}
+
+bool SharedWorldReader::isValid(const SharedWorldFrame& frame) const {
+    // Orders the caller's reads of the cells before the check
+    atomic_thread_fence(memory_order_acquire);
+    return header->slots[frame.slot].sequence.load(memory_order_relaxed) == frame.sequence;
+}
@@ -0,0 +1,107 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Shared-memory world segment, for tools running in other processes.
+//
+// The segment starts with SharedWorldHeader, padded to SHARED_WORLD_HEADER_SIZE,
+// followed by one slot per buffer of the sim's triple buffer. Each slot holds
+// height rows of width cells, one byte per cell (0 dead, 1 alive), row r at
+// r * rowStride. The engine simulates directly in these buffers, so publishing
+// costs it a few atomic stores per generation.
+//
+// Readers never block the engine. Both the latest (slot, generation) pair and
+// every slot are guarded by a seqlock: a sequence number that is odd while
+// the writer is changing the data. A reader takes a frame, uses it, and then
+// checks that the slot's sequence did not move (see SharedWorldReader).
+//
+// This header does not depend on the rest of the engine and together with
+// shared_world.cpp forms the reader library.
+constexpr char SHARED_WORLD_MAGIC[8] = {'G', 'O', 'L', 'S', 'H', 'M', '\0', '\0'};
+constexpr uint32_t SHARED_WORLD_VERSION = 1;
+constexpr int SHARED_WORLD_SLOTS = 3;
+constexpr size_t SHARED_WORLD_HEADER_SIZE = 4096;
+
+struct SharedWorldSlot {
+    std::atomic<uint64_t> sequence;
+    std::atomic<int64_t> generation;
+};
+
+struct SharedWorldHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowStride;
+    uint64_t slotOffset;  // first slot, from the segment start
+    uint64_t slotStride;
+
+    std::atomic<uint32_t> running;  // cleared when the engine exits
+
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint32_t> latestSlot;
+    std::atomic<int64_t> latestGeneration;
+
+    SharedWorldSlot slots[SHARED_WORLD_SLOTS];
+};
+static_assert(sizeof(SharedWorldHeader) <= SHARED_WORLD_HEADER_SIZE);
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "seqlocks must be address free");
+
+// Named shared-memory mapping (shm_open / CreateFileMapping).
+struct SharedMemory {
+    SharedMemory() = default;
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+    ~SharedMemory() { close(); }
+
+    // Creates or replaces the segment `name` and maps it read-write, zero filled.
+    bool create(const std::string& name, size_t segmentSize);
+
+    // Maps an existing segment read-only.
+    bool open(const std::string& name);
+
+    // Removes the name; existing mappings stay valid until they are closed.
+    void unlink();
+
+    void close();
+
+    uint8_t* data = nullptr;
+    size_t size = 0;
+
+private:
+    std::string systemName;
+#ifdef _WIN32
+    void* mappingHandle = nullptr;
+#endif
+};
+
+// One generation as found in the segment. `cells` is only trustworthy if
+// SharedWorldReader::isValid still holds after it was read.
+struct SharedWorldFrame {
+    const uint8_t* cells = nullptr;
+    int64_t generation = -1;
+    int slot = -1;
+    uint64_t sequence = 0;
+};
+
+struct SharedWorldReader {
+    bool open(const std::string& name);
+    void close() { memory.close(); header = nullptr; }
+
+    // Picks the latest published generation without copying it. Fails while
+    // the engine is in the middle of publishing, retry shortly after.
+    bool acquireLatest(SharedWorldFrame& frame) const;
+
+    // True if the frame's slot was not rewritten since acquireLatest.
+    bool isValid(const SharedWorldFrame& frame) const;
+
+    bool engineRunning() const { return header->running.load(std::memory_order_acquire) != 0; }
+
+    const SharedWorldHeader* header = nullptr;
+
+private:
+    SharedMemory memory;
+};
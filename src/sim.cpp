@@ -0,0 +1,428 @@
+﻿#include "sim.h"
+#include "generations.h"
+#include "ltl.h"
+#include "isotropic.h"
+#include "margolus.h"
+#include "life3d.h"
+#include "multistate.h"
+#include "wireworld.h"
+#include "stochastic.h"
+#include "topology.h"
+#include "recorder.h"
+#include "stats.h"
+#include "snapshot.h"
+#include "genlog.h"
+#include "shared_export.h"
+#include "stream.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <semaphore>
+
+using namespace std;
+
+// Live neighbours of column y in rows padded with a halo one cell deep,
+// where column y sits at index y + 1
+inline int countAliveAround(const bool* above, const bool* row, const bool* below, const int y) {
+    return above[y] + above[y + 1] + above[y + 2]
+        + row[y] + row[y + 2]
+        + below[y] + below[y + 1] + below[y + 2];
+}
+
+atomic<bool> trackCellAge {false};
+
+// With the masks known at compile time the shift folds into a couple of
+// instructions, the same work as comparing against a hard-coded rule.
+template<uint16_t Birth, uint16_t Survival, bool TrackAge>
+void simulateLifeStep(const World& worldNow, World& worldNext, const int minX, const int maxX) {
+    PaddedRows<bool> rows;
+    rows.start(worldNow, minX);
+
+    for (int x = minX; x < maxX; x++) {
+        if (x > minX) rows.next(worldNow);
+
+        for (int y = 0; y < N; y++) {
+            const int count = countAliveAround(rows.above, rows.row, rows.below, y);
+            const uint16_t mask = worldNow.Data[x][y] ? Survival : Birth;
+
+            worldNext.Data[x][y] = (mask >> count) & 1;
+            updateAge<TrackAge>(worldNow, worldNext, x, y);
+        }
+    }
+}
+
+// Next state by [alive][live neighbours], for rules without a specialization
+uint8_t ruleTable[2][9];
+
+template<bool TrackAge>
+void simulateTableStep(const World& worldNow, World& worldNext, const int minX, const int maxX) {
+    PaddedRows<bool> rows;
+    rows.start(worldNow, minX);
+
+    for (int x = minX; x < maxX; x++) {
+        if (x > minX) rows.next(worldNow);
+
+        for (int y = 0; y < N; y++) {
+            const int count = countAliveAround(rows.above, rows.row, rows.below, y);
+
+            worldNext.Data[x][y] = ruleTable[worldNow.Data[x][y]][count];
+            updateAge<TrackAge>(worldNow, worldNext, x, y);
+        }
+    }
+}
+
+struct RuleKernels {
+    Rule rule;
+    StepKernel step;
+    StepKernel stepWithAge;
+    void (*prepare)(int index) = nullptr;  // readies the engine's state of worlds[index]
+    int haloWidth = 1;                      // cells around the world the kernels read
+    StepKernel stepBackward = nullptr;      // reversible rules only
+    StepKernel stepBackwardWithAge = nullptr;
+    void (*finish)(const World& worldNow, World& worldNext) = nullptr;  // serial, once the workers are done
+};
+
+template<uint16_t Birth, uint16_t Survival>
+RuleKernels specializedKernels() {
+    Rule rule;
+    rule.life = {Birth, Survival, 2};
+    return {rule, simulateLifeStep<Birth, Survival, false>, simulateLifeStep<Birth, Survival, true>};
+}
+
+const RuleKernels SPECIALIZED_RULES[] = {
+    specializedKernels<countMask("3"), countMask("23")>(),              // Conway's Life
+    specializedKernels<countMask("36"), countMask("23")>(),             // HighLife
+    specializedKernels<countMask("3678"), countMask("34678")>(),        // Day & Night
+    specializedKernels<countMask("2"), countMask("")>(),                // Seeds
+    specializedKernels<countMask("3"), countMask("012345678")>(),       // Life without Death
+    specializedKernels<countMask("3"), countMask("12345")>(),           // Maze
+    specializedKernels<countMask("36"), countMask("125")>(),            // 2x2
+    specializedKernels<countMask("1357"), countMask("1357")>(),         // Replicator
+};
+
+RuleKernels ruleKernels = SPECIALIZED_RULES[0];
+
+void setSimRule(const Rule& rule) {
+    if (rule.family == RuleFamily::LargerThanLife) {
+        ruleKernels = {rule, nullptr, nullptr, nullptr, rule.ltl.range + 1};
+        ltlKernels(rule.ltl, ruleKernels.step, ruleKernels.stepWithAge);
+        return;
+    }
+
+    if (rule.family == RuleFamily::Isotropic) {
+        ruleKernels = {rule, nullptr, nullptr};
+        isotropicKernels(rule.isotropic, ruleKernels.step, ruleKernels.stepWithAge);
+        return;
+    }
+
+    if (rule.family == RuleFamily::Margolus) {
+        ruleKernels = {rule, nullptr, nullptr, prepareMargolusWorlds};
+        margolusKernels(rule.margolus, ruleKernels.step, ruleKernels.stepWithAge,
+                        ruleKernels.stepBackward, ruleKernels.stepBackwardWithAge);
+        return;
+    }
+
+    if (rule.family == RuleFamily::Life3D) {
+        ruleKernels = {rule, nullptr, nullptr, prepareLife3DWorlds};
+        life3dKernels(rule.life3d, ruleKernels.step, ruleKernels.stepWithAge);
+        ruleKernels.finish = finishLife3DStep;
+        return;
+    }
+
+    if (rule.family == RuleFamily::Table) {
+        ruleKernels = {rule, nullptr, nullptr, prepareStateWorlds};
+        tableKernels(*rule.table, ruleKernels.step, ruleKernels.stepWithAge);
+
+        if (const StepKernel sparse = wireworldKernel(*rule.table, rule.topology)) {
+            ruleKernels.step = sparse;
+            ruleKernels.prepare = prepareWireworldWorlds;
+        }
+        return;
+    }
+
+    // Generations, the other neighbourhoods and stochastic rules run on bit planes
+    if (rule.life.states > 2 || rule.life.shape != NeighbourhoodShape::Moore || stochasticSettings().enabled()) {
+        ruleKernels = {rule, nullptr, nullptr, prepareGenerationsWorlds};
+        generationsKernels(rule.life, ruleKernels.step, ruleKernels.stepWithAge);
+        return;
+    }
+
+    for (const RuleKernels& kernels : SPECIALIZED_RULES) {
+        if (kernels.rule.life == rule.life) {
+            ruleKernels = kernels;
+            ruleKernels.rule.topology = rule.topology;
+            return;
+        }
+    }
+
+    for (int count = 0; count <= 8; count++) {
+        ruleTable[0][count] = (rule.life.birth >> count) & 1;
+        ruleTable[1][count] = (rule.life.survival >> count) & 1;
+    }
+    ruleKernels = {rule, simulateTableStep<false>, simulateTableStep<true>};
+}
+
+const Rule& simRule() {
+    return ruleKernels.rule;
+}
+
+atomic<bool> simBackward {false};
+
+// Direction of the generation being stepped, set before the workers start it
+bool steppingBackward = false;
+
+void simulateLifeStep(const int minX = 0, const int maxX = N) {
+    WorldIndices loadedWorldIndices {worldIndicesStore.load()};
+
+    const World& worldNow = worlds[loadedWorldIndices.simOld];
+    World& worldNext = worlds[loadedWorldIndices.simNext];
+
+    if (steppingBackward) {
+        (trackCellAge ? ruleKernels.stepBackwardWithAge : ruleKernels.stepBackward)(worldNow, worldNext, minX, maxX);
+    } else if (trackCellAge) {
+        ruleKernels.stepWithAge(worldNow, worldNext, minX, maxX);
+    } else {
+        ruleKernels.step(worldNow, worldNext, minX, maxX);
+    }
+}
+
+atomic<int> simIndex {0};
+atomic<int> simGenerationLimit {0};
+
+
+atomic<bool> simPaced {false};
+counting_semaphore<> simGenerationPermits {0};
+
+void enableSimPacing() {
+    simPaced = true;
+}
+
+void releaseSimGenerations(const int count) {
+    simGenerationPermits.release(count);
+}
+
+
+atomic<bool> killSwitch {false};
+int simWorkerCount = DEFAULT_WORKER_COUNT;
+
+unique_ptr<atomic<bool>[]> workCanStart;
+atomic<int> workFinishedCount {0};
+
+// The worker threads outlive a simulateLoop call. They spin on workCanStart
+// during a run and block on workerRunSerial between runs, woken by it for
+// a run or for a task of runOnSimWorkers.
+vector<thread> simWorkers;
+atomic<bool> workersSpinning {false};
+atomic<int> workerRunSerial {0};
+atomic<int> workersInRun {0};
+atomic<bool> simWorkersExiting {false};
+const WorkerTask* workerTask = nullptr;  // set while runOnSimWorkers waits
+int workerTaskCount = 0;
+
+void simulateLoopWorker(const int wi, const int workerCount) {
+    int seenRun = 0;
+
+    while (true) {
+        workerRunSerial.wait(seenRun);
+        seenRun = workerRunSerial.load();
+        if (simWorkersExiting) return;
+
+        if (workerTask != nullptr) {
+            (*workerTask)(wi * workerTaskCount / workerCount, (wi + 1) * workerTaskCount / workerCount);
+        } else {
+            // N may differ from the previous run
+            const int minX = wi * N / workerCount;
+            const int maxX = (wi + 1) * N / workerCount;
+
+            while (workersSpinning) {
+                if (bool yes = true; workCanStart[wi].compare_exchange_strong(yes, false)) {
+                    simulateLifeStep(minX, maxX);
+                    ++workFinishedCount;
+                }
+            }
+        }
+
+        --workersInRun;
+        workersInRun.notify_all();
+    }
+}
+
+// Starts the helper threads for simWorkerCount, the calling thread being the last worker
+int ensureSimWorkers() {
+    const int helperCount = max(0, simWorkerCount - 1);
+
+    if (static_cast<int>(simWorkers.size()) != helperCount) {
+        stopSimWorkers();
+
+        workCanStart = make_unique<atomic<bool>[]>(helperCount);
+        for (int wi = 0; wi < helperCount; wi++) {
+            simWorkers.emplace_back(simulateLoopWorker, wi, simWorkerCount);
+        }
+    }
+    return helperCount;
+}
+
+void beginWorkerRun() {
+    const int helperCount = ensureSimWorkers();
+
+    for (int wi = 0; wi < helperCount; wi++) {
+        workCanStart[wi] = false;
+    }
+    workFinishedCount = 0;
+    workersInRun = helperCount;
+    workersSpinning = true;
+
+    ++workerRunSerial;
+    workerRunSerial.notify_all();
+}
+
+// Returns once every worker finished its last step and went idle
+void endWorkerRun() {
+    workersSpinning = false;
+
+    for (int inRun; (inRun = workersInRun.load()) != 0;) {
+        workersInRun.wait(inRun);
+    }
+}
+
+void runOnSimWorkers(const int count, const WorkerTask& task) {
+    const int helperCount = ensureSimWorkers();
+
+    workerTask = &task;
+    workerTaskCount = count;
+    workersInRun = helperCount;
+
+    ++workerRunSerial;
+    workerRunSerial.notify_all();
+
+    task(helperCount * count / (helperCount + 1), count);
+    endWorkerRun();
+    workerTask = nullptr;
+}
+
+void stopSimWorkers() {
+    if (simWorkers.empty()) return;
+
+    simWorkersExiting = true;
+    ++workerRunSerial;
+    workerRunSerial.notify_all();
+
+    for (auto& worker : simWorkers) {
+        worker.join();
+    }
+    simWorkers.clear();
+    simWorkersExiting = false;
+}
+
+GenerationSource generationSource = nullptr;
+
+void setGenerationSource(const GenerationSource source) {
+    generationSource = source;
+}
+
+void resetSimulation() {
+    killSwitch = false;
+    simIndex = 0;
+    simGenerationLimit = 0;
+    generationSource = nullptr;
+    worldIndicesStore = WorldIndices{}.toInt();
+}
+
+void simulateLoop() {
+    // Workers are only needed when the sim computes generations itself
+    const bool simulating = generationSource == nullptr;
+    if (simulating) {
+        if (ruleKernels.prepare != nullptr) {
+            ruleKernels.prepare(WorldIndices{worldIndicesStore.load()}.simOld);
+        }
+        beginWorkerRun();
+    }
+
+    const int helperCount = static_cast<int>(simWorkers.size());
+    const int minX = helperCount * N / (helperCount + 1);
+    const int maxX = N;
+
+    startSnapshotService();
+
+    chrono::steady_clock::time_point lastGenerationAt = chrono::steady_clock::now();
+
+    while (!killSwitch) {
+        if (simPaced) {
+            simGenerationPermits.acquire();
+            if (killSwitch) break;
+        }
+
+        ScopedPhase phase {Phase::SimStep};
+
+        const int nextIndex = WorldIndices{worldIndicesStore.load()}.simNext;
+        World& completedWorld = worlds[nextIndex];
+        int generation = simIndex + 1;
+
+        sharedWorldBeginWrite(nextIndex);
+
+        if (simulating) {
+            const World& worldNow = worlds[WorldIndices{worldIndicesStore.load()}.simOld];
+            fillHalo(worldNow, ruleKernels.rule.topology, ruleKernels.haloWidth);
+            steppingBackward = simBackward && ruleKernels.stepBackward != nullptr;
+
+            for (int wi = 0; wi < helperCount; wi++) {
+                workCanStart[wi].store(true);
+            }
+
+            simulateLifeStep(minX, maxX);
+
+            phase.restart(Phase::SimBarrier);
+
+            while (!killSwitch && workFinishedCount < helperCount) { }
+            workFinishedCount = 0;
+
+            if (killSwitch) break;
+
+            if (ruleKernels.finish != nullptr) {
+                ruleKernels.finish(worldNow, completedWorld);
+            }
+        } else {
+            generation = generationSource(completedWorld);
+
+            if (generation == SOURCE_EXHAUSTED) {
+                killSwitch = true;
+                break;
+            }
+            if (generation == SOURCE_IDLE) {
+                this_thread::sleep_for(chrono::milliseconds(1));
+                continue;
+            }
+        }
+
+        phase.restart(Phase::SimSwap);
+
+        const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        phaseTimer(Phase::SimGeneration).record(chrono::duration<float>(now - lastGenerationAt).count());
+        lastGenerationAt = now;
+
+        completedWorld.Generation = generation;
+        completedWorld.CompletedAt = now;
+
+        recorderCapture(completedWorld, completedWorld.Generation);
+        generationLogCapture(completedWorld);
+        serviceSnapshotRequest(completedWorld);
+        streamCapture(completedWorld);
+        sharedWorldPublish(nextIndex, generation);
+
+        moveWorldSimIndices();
+
+        simIndex = generation;
+        if (generation == simGenerationLimit) {
+            killSwitch = true;
+        }
+    }
+
+    stopSnapshotService();
+
+    if (simulating) {
+        endWorkerRun();
+    }
+}
@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include "world.h"
+#include "rule.h"
+
+#include <atomic>
+#include <functional>
+
+// Threads stepping each generation, the sim thread included. Read when
+// simulateLoop starts; the worker threads persist between calls.
+constexpr int DEFAULT_WORKER_COUNT = 10;
+extern int simWorkerCount;
+
+// Computes rows [minX, maxX) of worldNext from worldNow
+using StepKernel = void (*)(const World& worldNow, World& worldNext, int minX, int maxX);
+
+// Rule of the step kernel. Common rules have kernels specialized at compile
+// time, any other goes through a lookup table. Set between runs only.
+void setSimRule(const Rule& rule);
+const Rule& simRule();
+
+extern std::atomic<bool> killSwitch;
+
+// Generation counter of the latest completed simulation step.
+extern std::atomic<int> simIndex;
+
+// Makes the step kernel maintain World::Age alongside the next state.
+extern std::atomic<bool> trackCellAge;
+
+// Steps a reversible rule (a Margolus rule whose table is a permutation)
+// backward, each generation undoing the one before; other rules ignore it.
+// Read at the start of every generation. Generations still count up.
+extern std::atomic<bool> simBackward;
+
+// Age of cell (x, y) in worldNext once its next state is written
+template<bool TrackAge>
+void updateAge(const World& worldNow, World& worldNext, const int x, const int y) {
+    if constexpr (TrackAge) {
+        const uint8_t age = worldNow.Age[x][y];
+        const bool unchanged = worldNext.Data[x][y] == worldNow.Data[x][y];
+        worldNext.Age[x][y] = static_cast<uint8_t>((age + (age != 0xFF)) * unchanged);
+    }
+}
+
+// When positive, the simulation raises killSwitch once simIndex reaches it.
+extern std::atomic<int> simGenerationLimit;
+
+// Render-synchronized pacing: once enabled the sim only computes a generation
+// for each permit handed out through releaseSimGenerations.
+void enableSimPacing();
+void releaseSimGenerations(int count);
+
+// Replaces simulation with an external source of generations, e.g. a log
+// replay. The source fills `next` and returns its generation number, or
+// SOURCE_IDLE when it has nothing new yet, or SOURCE_EXHAUSTED at its end.
+constexpr int SOURCE_IDLE = -1;
+constexpr int SOURCE_EXHAUSTED = -2;
+using GenerationSource = int (*)(World& next);
+void setGenerationSource(GenerationSource source);
+
+void simulateLoop();
+
+// Puts the sim back to generation 0 with fresh world indices, no generation
+// source and no limit, for another run in the same process.
+void resetSimulation();
+
+// Splits [0, count) between the simWorkerCount workers and returns once each
+// ran `task` on its part. Only between runs, e.g. to seed a world.
+using WorkerTask = std::function<void(int first, int last)>;
+void runOnSimWorkers(int count, const WorkerTask& task);
+
+// Ends the worker threads kept between simulateLoop calls.
+void stopSimWorkers();
@@ -0,0 +1,112 @@
+﻿#include "snapshot.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+mutex snapshotMutex;
+condition_variable snapshotTaken;
+bool snapshotServiceRunning = false;
+World* snapshotTarget = nullptr;
+atomic<bool> snapshotRequested {false};
+
+struct SnapshotJob {
+    thread worker;
+    shared_ptr<atomic<bool>> done;
+};
+
+mutex snapshotJobsMutex;
+vector<SnapshotJob> snapshotJobs;
+
+void copyLatestWorld(World& snapshot) {
+    const WorldIndices loadedWorldIndices {worldIndicesStore.load()};
+    snapshot.copyFrom(worlds[loadedWorldIndices.simOld]);
+}
+
+void takeWorldSnapshot(World& snapshot) {
+    unique_lock lock(snapshotMutex);
+
+    // Another request is still pending, wait for our turn
+    snapshotTaken.wait(lock, [] { return snapshotTarget == nullptr || !snapshotServiceRunning; });
+
+    if (!snapshotServiceRunning) {
+        copyLatestWorld(snapshot);
+        return;
+    }
+
+    snapshotTarget = &snapshot;
+    snapshotRequested = true;
+    snapshotTaken.wait(lock, [&] { return snapshotTarget != &snapshot || !snapshotServiceRunning; });
+
+    if (snapshotTarget == &snapshot) {
+        // The sim stopped before serving the request
+        snapshotTarget = nullptr;
+        snapshotRequested = false;
+        copyLatestWorld(snapshot);
+    }
+}
+
+void runOnSnapshot(function<void(const World&)> job) {
+    lock_guard lock(snapshotJobsMutex);
+
+    // Reap jobs that already finished so periodic jobs don't pile up threads
+    erase_if(snapshotJobs, [](SnapshotJob& finished) {
+        if (!*finished.done) return false;
+        finished.worker.join();
+        return true;
+    });
+
+    auto done = make_shared<atomic<bool>>(false);
+    thread worker {[job = move(job), done] {
+        // Snapshot on the job thread too: a paced sim only advances when the
+        // render thread asks for it, so the render thread must not wait here
+        const auto snapshot = make_unique<World>();
+        takeWorldSnapshot(*snapshot);
+        job(*snapshot);
+        *done = true;
+    }};
+
+    snapshotJobs.push_back({move(worker), move(done)});
+}
+
+void waitForSnapshotJobs() {
+    vector<SnapshotJob> jobs;
+    {
+        lock_guard lock(snapshotJobsMutex);
+        jobs.swap(snapshotJobs);
+    }
+
+    for (auto& job : jobs) {
+        job.worker.join();
+    }
+}
+
+void startSnapshotService() {
+    lock_guard lock(snapshotMutex);
+    snapshotServiceRunning = true;
+}
+
+void serviceSnapshotRequest(const World& completedWorld) {
+    if (!snapshotRequested) return;
+
+    {
+        lock_guard lock(snapshotMutex);
+        snapshotTarget->copyFrom(completedWorld);
+        snapshotTarget = nullptr;
+        snapshotRequested = false;
+    }
+    snapshotTaken.notify_all();
+}
+
+void stopSnapshotService() {
+    {
+        lock_guard lock(snapshotMutex);
+        snapshotServiceRunning = false;
+    }
+    snapshotTaken.notify_all();
+}
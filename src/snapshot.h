@@ -0,0 +1,22 @@
+﻿#pragma once
+
+#include "world.h"
+
+#include <functional>
+
+// Copies the most recent completed generation into `snapshot`. While the sim
+// runs the copy is made by the sim thread between two generations, so the
+// caller never observes a buffer that is being written.
+void takeWorldSnapshot(World& snapshot);
+
+// Takes a snapshot on a background thread and hands it to `job` there, so
+// slow encoders never hold up the sim or the render loop.
+void runOnSnapshot(std::function<void(const World&)> job);
+
+// Joins every job started by runOnSnapshot.
+void waitForSnapshotJobs();
+
+// Sim thread hooks.
+void startSnapshotService();
+void serviceSnapshotRequest(const World& completedWorld);
+void stopSnapshotService();
@@ -0,0 +1,142 @@
+﻿#include "stats.h"
+#include "sim.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+PhaseTimer phaseTimers[PHASE_COUNT];
+
+const char* phaseName(const Phase phase) {
+    switch (phase) {
+        case Phase::SimStep: return "sim_step";
+        case Phase::SimBarrier: return "sim_barrier";
+        case Phase::SimSwap: return "sim_swap";
+        case Phase::SimGeneration: return "sim_generation";
+        case Phase::RenderWait: return "render_wait";
+        case Phase::RenderConvert: return "render_convert";
+        case Phase::RenderUpload: return "render_upload";
+        case Phase::RenderDraw: return "render_draw";
+        case Phase::RenderFrame: return "render_frame";
+        default: return "unknown";
+    }
+}
+
+void PhaseTimer::record(const float seconds) {
+    const uint32_t index = recorded.load(memory_order_relaxed);
+    samples[index % WINDOW].store(seconds, memory_order_relaxed);
+    recorded.store(index + 1, memory_order_release);
+}
+
+PhaseSummary PhaseTimer::summarize() const {
+    PhaseSummary summary;
+
+    float window[WINDOW];
+    summary.count = static_cast<int>(min<uint32_t>(recorded.load(memory_order_acquire), WINDOW));
+    if (summary.count == 0) return summary;
+
+    double sum = 0;
+    for (int i = 0; i < summary.count; i++) {
+        window[i] = samples[i].load(memory_order_relaxed);
+        sum += window[i];
+    }
+    summary.mean = static_cast<float>(sum / summary.count);
+
+    const auto percentile = [&](const float p) {
+        const int rank = min(summary.count - 1, static_cast<int>(p * static_cast<float>(summary.count)));
+        nth_element(window, window + rank, window + summary.count);
+        return window[rank];
+    };
+    summary.p50 = percentile(0.50f);
+    summary.p99 = percentile(0.99f);
+    summary.max = *max_element(window, window + summary.count);
+
+    return summary;
+}
+
+int GetSPS() {
+    const PhaseSummary generation = phaseTimer(Phase::SimGeneration).summarize();
+    if (generation.count == 0 || generation.mean == 0) return 0;
+
+    return static_cast<int>(roundf(1.0f / generation.mean));
+}
+
+string formatPhaseTable() {
+    string table = format("{:<16} {:>8} {:>8} {:>8}\n", "phase", "p50 ms", "p99 ms", "max ms");
+
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        const Phase phase = static_cast<Phase>(i);
+        const PhaseSummary summary = phaseTimer(phase).summarize();
+        if (summary.count == 0) continue;
+
+        table += format("{:<16} {:>8.3f} {:>8.3f} {:>8.3f}\n",
+            phaseName(phase), summary.p50 * 1000, summary.p99 * 1000, summary.max * 1000);
+    }
+
+    return table;
+}
+
+
+mutex statsLogMutex;
+condition_variable statsLogWake;
+bool statsLogStopping = false;
+thread statsLogThread;
+
+string formatStatsRecord(const double elapsedSeconds) {
+    string record = format("{{\"t\":{:.3f},\"sim_index\":{}", elapsedSeconds, simIndex.load());
+
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        const Phase phase = static_cast<Phase>(i);
+        const PhaseSummary summary = phaseTimer(phase).summarize();
+        if (summary.count == 0) continue;
+
+        record += format(",\"{}\":{{\"n\":{},\"mean\":{:.6f},\"p50\":{:.6f},\"p99\":{:.6f},\"max\":{:.6f}}}",
+            phaseName(phase), summary.count, summary.mean, summary.p50, summary.p99, summary.max);
+    }
+
+    return record + "}\n";
+}
+
+bool startStatsLog(const string& path, const float intervalSeconds) {
+    if (path.empty()) return true;
+
+    ofstream log {path, ios::app};
+    if (!log) {
+        cerr << format("Cannot open stats log '{}'\n", path);
+        return false;
+    }
+
+    const chrono::duration<float> interval {max(0.01f, intervalSeconds)};
+    statsLogStopping = false;
+
+    statsLogThread = thread{[log = move(log), interval]() mutable {
+        const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        unique_lock lock(statsLogMutex);
+        while (!statsLogWake.wait_for(lock, interval, [] { return statsLogStopping; })) {
+            const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+            log << formatStatsRecord(elapsed.count());
+            log.flush();
+        }
+    }};
+
+    return true;
+}
+
+void stopStatsLog() {
+    if (!statsLogThread.joinable()) return;
+
+    {
+        lock_guard lock(statsLogMutex);
+        statsLogStopping = true;
+    }
+    statsLogWake.notify_all();
+    statsLogThread.join();
+}
@@ -0,0 +1,82 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+enum class Phase {
+    SimStep,        // sim thread computing its own stripe
+    SimBarrier,     // sim thread waiting for the other workers
+    SimSwap,        // publishing the generation (capture hooks + index swap)
+    SimGeneration,  // wall time of a whole generation
+    RenderWait,     // pacing sleep before the buffer handover
+    RenderConvert,  // world to pixel conversion
+    RenderUpload,   // texture upload
+    RenderDraw,     // draw calls, HUD and present
+    RenderFrame,    // wall time of a whole frame
+    Count,
+};
+
+constexpr int PHASE_COUNT = static_cast<int>(Phase::Count);
+
+const char* phaseName(Phase phase);
+
+struct PhaseSummary {
+    int count = 0;
+    float mean = 0;
+    float p50 = 0;
+    float p99 = 0;
+    float max = 0;
+};
+
+// Rolling window of the most recent samples of one phase, in seconds.
+// Each phase is recorded by a single thread; any thread may summarize it.
+struct PhaseTimer {
+    static constexpr int WINDOW = 256;
+
+    void record(float seconds);
+    PhaseSummary summarize() const;
+
+private:
+    std::atomic<float> samples[WINDOW] {};
+    std::atomic<uint32_t> recorded {0};
+};
+
+extern PhaseTimer phaseTimers[PHASE_COUNT];
+
+inline PhaseTimer& phaseTimer(const Phase phase) {
+    return phaseTimers[static_cast<int>(phase)];
+}
+
+// Records the time from construction, or the last restart, to destruction.
+struct ScopedPhase {
+    explicit ScopedPhase(const Phase phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+    ~ScopedPhase() { stop(); }
+
+    // Ends the current phase and starts timing nextPhase from now.
+    void restart(const Phase nextPhase) {
+        stop();
+        phase = nextPhase;
+    }
+
+private:
+    void stop() {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        phaseTimer(phase).record(std::chrono::duration<float>(now - start).count());
+        start = now;
+    }
+
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Generations per second over the SimGeneration window.
+int GetSPS();
+
+// Human readable table of all phases with samples, one phase per line.
+std::string formatPhaseTable();
+
+// Periodically appends one JSON object per line with every phase summary.
+bool startStatsLog(const std::string& path, float intervalSeconds);
+void stopStatsLog();
@@ -0,0 +1,22 @@
+﻿#include "stochastic.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+StochasticSettings currentStochasticSettings;
+
+void setStochasticSettings(const StochasticSettings& settings) {
+    currentStochasticSettings = settings;
+}
+
+const StochasticSettings& stochasticSettings() {
+    return currentStochasticSettings;
+}
+
+BernoulliStream::BernoulliStream(const uint64_t seed, const int stream, const float probability) {
+    // Streams of one seed are independent of each other and of seedWorld's cells
+    key = mixBits(seedKey(seed) ^ mixBits(static_cast<uint64_t>(stream) + 1));
+    threshold = static_cast<uint32_t>(llround(clamp(static_cast<double>(probability), 0.0, 1.0) * (1u << BERNOULLI_BITS)));
+}
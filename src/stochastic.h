@@ -0,0 +1,52 @@
+﻿#pragma once
+
+#include "seed.h"
+
+#include <bit>
+#include <cstdint>
+
+// Probabilistic variant of a Life-like rule, for noise studies: a birth or a
+// survival the rule calls for happens with its probability, then dead and
+// live cells flip with `flip`. Dying cells of Generations rules never flip.
+struct StochasticSettings {
+    float birth = 1.f;
+    float survival = 1.f;
+    float flip = 0.f;
+    uint64_t seed = 1;
+
+    bool enabled() const { return birth < 1.f || survival < 1.f || flip > 0.f; }
+};
+
+// Read by setSimRule, so set before it. Life-like rules run on the bit-plane
+// engine (generations.h) while enabled.
+void setStochasticSettings(const StochasticSettings& settings);
+const StochasticSettings& stochasticSettings();
+
+// Random cells set with a probability in steps of 1 / 2^BERNOULLI_BITS, 64 at
+// a time. Like seedCell the words are a pure function of the seed and a
+// counter, so the cell's position and generation, whatever the thread count.
+constexpr int BERNOULLI_BITS = 16;
+
+struct BernoulliStream {
+    uint64_t key = 0;
+    uint32_t threshold = 0;  // probability * 2^BERNOULLI_BITS
+
+    BernoulliStream() = default;
+    BernoulliStream(uint64_t seed, int stream, float probability);
+
+    // Combining random words from the lowest set bit of the threshold up, OR
+    // for a one bit and AND for a zero, halves the probability of a set cell
+    // and adds the bit at each step: at most BERNOULLI_BITS hashes per word,
+    // one for a probability of 1/2.
+    uint64_t word(const uint64_t counter) const {
+        if (threshold == 0) return 0;
+        if (threshold >= 1u << BERNOULLI_BITS) return ~0ull;
+
+        uint64_t cells = 0;
+        for (int bit = std::countr_zero(threshold); bit < BERNOULLI_BITS; bit++) {
+            const uint64_t random = mixBits(key + (counter * BERNOULLI_BITS + bit) * 0x9E3779B97F4A7C15ull);
+            cells = threshold >> bit & 1 ? cells | random : cells & random;
+        }
+        return cells;
+    }
+};
@@ -0,0 +1,317 @@
+﻿#include "stream.h"
+#include "packed_world.h"
+#include "net.h"
+#include "sim.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <string_view>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct StreamFrame {
+    vector<uint64_t> words = vector<uint64_t>(packedWorldWords());
+    int generation = 0;
+};
+
+struct StreamClient {
+    SocketHandle socket = INVALID_SOCKET_HANDLE;
+    thread worker;
+    atomic<bool> done {false};
+};
+
+mutex streamServerMutex;
+condition_variable streamFrameCaptured;
+shared_ptr<const StreamFrame> latestStreamFrame;
+uint64_t streamFrameSerial = 0;
+atomic<int> streamWaiters {0};
+bool streamStopping = false;
+
+SocketHandle streamListener = INVALID_SOCKET_HANDLE;
+thread streamAcceptor;
+list<unique_ptr<StreamClient>> streamClients;
+
+StreamHello makeStreamHello(const float rate) {
+    StreamHello hello {};
+    memcpy(hello.magic, STREAM_MAGIC, sizeof(STREAM_MAGIC));
+    hello.version = STREAM_VERSION;
+    hello.width = N;
+    hello.height = N;
+    hello.rate = rate;
+    formatRule(simRule()).copy(hello.rule, sizeof(hello.rule) - 1);
+    return hello;
+}
+
+bool sendStreamFrame(const SocketHandle socket, const bool keyframe, const int generation, const vector<uint8_t>& payload) {
+    const StreamFrameHeader header {keyframe, static_cast<uint32_t>(payload.size()), generation};
+    return sendAll(socket, &header, sizeof(header)) && sendAll(socket, payload.data(), payload.size());
+}
+
+void serveStreamClient(StreamClient& client) {
+    StreamHello hello;
+    if (!receiveAll(client.socket, &hello, sizeof(hello))
+        || memcmp(hello.magic, STREAM_MAGIC, sizeof(STREAM_MAGIC)) != 0 || hello.version != STREAM_VERSION) {
+        client.done = true;
+        return;
+    }
+
+    const StreamHello reply = makeStreamHello(hello.rate);
+    if (!sendAll(client.socket, &reply, sizeof(reply))) {
+        client.done = true;
+        return;
+    }
+
+    const auto interval = chrono::duration_cast<chrono::steady_clock::duration>(
+        chrono::duration<float>(hello.rate > 0 ? 1.0f / hello.rate : 0.0f));
+
+    const size_t wordCount = packedWorldWords();
+    vector<uint64_t> previous(wordCount);
+    vector<uint64_t> delta(wordCount);
+    vector<uint8_t> payload;
+    bool keyframe = true;
+    chrono::steady_clock::time_point due = chrono::steady_clock::now();
+
+    while (true) {
+        this_thread::sleep_until(due);
+        due = max(due + interval, chrono::steady_clock::now());
+
+        // Wait for a generation completed from now on, skipping whatever the
+        // sim produced since the last frame went out
+        shared_ptr<const StreamFrame> frame;
+        {
+            unique_lock lock {streamServerMutex};
+            const uint64_t waitedFrom = streamFrameSerial;
+
+            ++streamWaiters;
+            streamFrameCaptured.wait(lock, [&] { return streamStopping || streamFrameSerial != waitedFrom; });
+            --streamWaiters;
+
+            if (streamStopping) break;
+            frame = latestStreamFrame;
+        }
+
+        payload.clear();
+        if (keyframe) {
+            encodeWords(frame->words.data(), wordCount, payload);
+        } else {
+            for (size_t i = 0; i < wordCount; i++) {
+                delta[i] = frame->words[i] ^ previous[i];
+            }
+            encodeWords(delta.data(), wordCount, payload);
+        }
+        previous = frame->words;
+
+        if (!sendStreamFrame(client.socket, keyframe, frame->generation, payload)) break;
+        keyframe = false;
+    }
+
+    client.done = true;
+}
+
+// Joins finished client threads; all of them when stopping
+void reapStreamClients(const bool all) {
+    for (auto it = streamClients.begin(); it != streamClients.end();) {
+        StreamClient& client = **it;
+        if (!all && !client.done) {
+            ++it;
+            continue;
+        }
+
+        shutdownSocket(client.socket);
+        client.worker.join();
+        closeSocket(client.socket);
+        it = streamClients.erase(it);
+    }
+}
+
+void acceptStreamClients() {
+    while (true) {
+        {
+            lock_guard lock {streamServerMutex};
+            if (streamStopping) break;
+        }
+
+        reapStreamClients(false);
+
+        const SocketHandle socket = acceptTcp(streamListener, 100);
+        if (socket == INVALID_SOCKET_HANDLE) continue;
+
+        auto& client = streamClients.emplace_back(make_unique<StreamClient>());
+        client->socket = socket;
+        client->worker = thread {serveStreamClient, ref(*client)};
+    }
+
+    reapStreamClients(true);
+}
+
+bool startStreamServer(const string& host, const int port) {
+    if (port <= 0) return true;
+
+    streamListener = listenTcp(host, port);
+    if (streamListener == INVALID_SOCKET_HANDLE) {
+        cerr << format("Cannot listen on {}:{}\n", host, port);
+        return false;
+    }
+
+    // A server stopped earlier in this process left its state behind
+    {
+        lock_guard lock {streamServerMutex};
+        streamStopping = false;
+        latestStreamFrame = nullptr;
+    }
+
+    streamAcceptor = thread {acceptStreamClients};
+    cerr << format("Streaming on {}:{}\n", host, port);
+    return true;
+}
+
+void streamCapture(const World& world) {
+    if (streamWaiters.load(memory_order_relaxed) == 0) return;
+
+    auto frame = make_shared<StreamFrame>();
+    packWorld(world, frame->words.data());
+    frame->generation = world.Generation;
+
+    {
+        lock_guard lock {streamServerMutex};
+        ++streamFrameSerial;
+        latestStreamFrame = move(frame);
+    }
+    streamFrameCaptured.notify_all();
+}
+
+void stopStreamServer() {
+    if (!streamAcceptor.joinable()) return;
+
+    {
+        lock_guard lock {streamServerMutex};
+        streamStopping = true;
+    }
+    streamFrameCaptured.notify_all();
+
+    // Shuts down every client socket, which unblocks sends to stalled viewers
+    streamAcceptor.join();
+    closeSocket(streamListener);
+    streamListener = INVALID_SOCKET_HANDLE;
+}
+
+
+SocketHandle streamConnection = INVALID_SOCKET_HANDLE;
+thread streamReceiver;
+mutex receivedFrameMutex;
+vector<uint64_t> receivedWords;
+int receivedGeneration = 0;
+bool receivedFrameFresh = false;
+atomic<bool> streamEnded {false};
+bool streamHoldAtEnd = false;
+
+// Reads one frame and applies it to `words`
+bool receiveStreamFrame(vector<uint64_t>& words, vector<uint8_t>& payload, int& generation, bool& keyframe) {
+    StreamFrameHeader header;
+    if (!receiveAll(streamConnection, &header, sizeof(header))) return false;
+
+    // The length comes from the peer, a frame can't encode more than a world
+    if (header.payloadSize > maxEncodedSize(packedWorldWords())) {
+        cerr << format("Stream frame of {} bytes is larger than any {}x{} world\n", header.payloadSize, N, N);
+        return false;
+    }
+
+    payload.resize(header.payloadSize);
+    if (!receiveAll(streamConnection, payload.data(), payload.size())) return false;
+
+    generation = static_cast<int>(header.generation);
+    keyframe = header.keyframe != 0;
+    return decodeWords(payload.data(), payload.data() + payload.size(), words.data(), packedWorldWords(), keyframe);
+}
+
+void receiveStream(vector<uint64_t> words) {
+    vector<uint8_t> payload;
+    int generation;
+    bool keyframe;
+
+    while (receiveStreamFrame(words, payload, generation, keyframe)) {
+        lock_guard lock {receivedFrameMutex};
+        receivedWords = words;
+        receivedGeneration = generation;
+        receivedFrameFresh = true;
+    }
+
+    streamEnded = true;
+}
+
+int streamNextGeneration(World& next) {
+    {
+        lock_guard lock {receivedFrameMutex};
+        if (receivedFrameFresh) {
+            unpackWorld(receivedWords.data(), next);
+            receivedFrameFresh = false;
+            return receivedGeneration;
+        }
+    }
+
+    return streamEnded && !streamHoldAtEnd ? SOURCE_EXHAUSTED : SOURCE_IDLE;
+}
+
+bool startStreamClient(const string& host, const int port, const float rate, const bool holdAtEnd, World& initialWorld) {
+    streamConnection = connectTcp(host, port);
+    if (streamConnection == INVALID_SOCKET_HANDLE) {
+        cerr << format("Cannot connect to {}:{}\n", host, port);
+        return false;
+    }
+
+    const StreamHello hello = makeStreamHello(rate);
+    StreamHello reply;
+    if (!sendAll(streamConnection, &hello, sizeof(hello)) || !receiveAll(streamConnection, &reply, sizeof(reply))
+        || memcmp(reply.magic, STREAM_MAGIC, sizeof(STREAM_MAGIC)) != 0 || reply.version != STREAM_VERSION) {
+        cerr << format("{}:{} is not a world stream\n", host, port);
+        stopStreamClient();
+        return false;
+    }
+
+    if (reply.width != static_cast<uint32_t>(N) || reply.height != static_cast<uint32_t>(N)) {
+        cerr << format("Stream world is {}x{}, the world is {}x{} (see --size)\n", reply.width, reply.height, N, N);
+        stopStreamClient();
+        return false;
+    }
+
+    vector<uint64_t> words(packedWorldWords());
+    vector<uint8_t> payload;
+    int generation;
+    bool keyframe;
+    if (!receiveStreamFrame(words, payload, generation, keyframe) || !keyframe) {
+        cerr << "Stream ended before its first keyframe\n";
+        stopStreamClient();
+        return false;
+    }
+
+    unpackWorld(words.data(), initialWorld);
+    initialWorld.Generation = generation;
+    simIndex = generation;
+
+    streamHoldAtEnd = holdAtEnd;
+    streamReceiver = thread {receiveStream, move(words)};
+    setGenerationSource(streamNextGeneration);
+
+    const string_view rule {reply.rule, strnlen(reply.rule, sizeof(reply.rule))};
+    cerr << format("Watching {}:{}, rule {}\n", host, port, rule);
+    return true;
+}
+
+void stopStreamClient() {
+    if (streamConnection == INVALID_SOCKET_HANDLE) return;
+
+    shutdownSocket(streamConnection);
+    if (streamReceiver.joinable()) streamReceiver.join();
+    closeSocket(streamConnection);
+    streamConnection = INVALID_SOCKET_HANDLE;
+}
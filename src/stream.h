@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include "world.h"
+
+#include <cstdint>
+#include <string>
+
+// Live world stream over TCP, little-endian:
+//   client: StreamHello with the highest rate it wants
+//   server: StreamHello with the world size, then frames
+//   frame:  StreamFrameHeader, payload
+//
+// The first frame is a keyframe coding the bit-packed world, every later
+// one the XOR with the previous frame sent to that client, both in the word
+// coding of packed_world.h. Each client gets the latest generation when it
+// is due, so slow clients and low rates skip generations instead of
+// holding back the sim.
+constexpr uint32_t STREAM_VERSION = 1;
+constexpr char STREAM_MAGIC[8] = {'G', 'O', 'L', 'S', 'T', 'R', 'M', '\0'};
+
+struct StreamHello {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    float rate;  // client: generations per second it wants, 0 = all it can take
+    char rule[64];
+};
+
+struct StreamFrameHeader {
+    uint32_t keyframe;
+    uint32_t payloadSize;
+    int64_t generation;
+};
+
+// Serves the world on host:port to any number of viewers.
+bool startStreamServer(const std::string& host, int port);
+
+// Called by the sim thread for every completed generation. Only packs the
+// world when a client is waiting for a frame.
+void streamCapture(const World& world);
+
+void stopStreamServer();
+
+// Connects to a stream server, receives its first keyframe into `initialWorld`
+// and makes the stream the sim's generation source. With holdAtEnd the sim
+// idles on the last frame once the server goes away instead of stopping.
+bool startStreamClient(const std::string& host, int port, float rate, bool holdAtEnd, World& initialWorld);
+
+void stopStreamClient();
@@ -0,0 +1,135 @@
+﻿#include "topology.h"
+
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+struct Halo {
+    int width = 0;
+    int stride = 0;                 // N + 2 * width
+    vector<uint8_t> outsideRows;    // rows -width .. -1, then N .. N + width - 1, stride cells each
+    vector<uint8_t> sides;          // per row: columns -width .. -1, then N .. N + width - 1
+};
+
+Halo halo;
+
+inline bool insideWorld(const int i) {
+    return 0 <= i && i < N;
+}
+
+inline int wrapOnce(const int i) {
+    return i < 0 ? i + N : i >= N ? i - N : i;
+}
+
+// Cell (x, y) at most N outside the world, as the topology joins the edges.
+// Twisted edges mirror the other coordinate. Corner cells follow one edge
+// after the other, except on the sphere whose corner cells stay dead.
+uint8_t outsideCell(const uint8_t* cells, const Topology topology, int x, int y) {
+    const auto cell = [cells](const int cellX, const int cellY) { return cells[static_cast<size_t>(cellX) * N + cellY]; };
+
+    switch (topology) {
+    case Topology::Torus:
+        return cell(wrapOnce(x), wrapOnce(y));
+    case Topology::Plane:
+        return insideWorld(x) && insideWorld(y) ? cell(x, y) : 0;
+    case Topology::KleinBottle:
+        if (!insideWorld(x)) {
+            x = wrapOnce(x);
+            y = N - 1 - y;
+        }
+        return cell(x, wrapOnce(y));
+    case Topology::KleinBottleSides:
+        if (!insideWorld(y)) {
+            y = wrapOnce(y);
+            x = N - 1 - x;
+        }
+        return cell(wrapOnce(x), y);
+    case Topology::CrossSurface:
+        if (!insideWorld(x)) {
+            x = wrapOnce(x);
+            y = N - 1 - y;
+        }
+        if (!insideWorld(y)) {
+            y = wrapOnce(y);
+            x = N - 1 - x;
+        }
+        return cell(x, y);
+    case Topology::Sphere:
+        if (insideWorld(y)) {
+            if (x < 0) return cell(y, -x - 1);
+            if (x >= N) return cell(y, 2 * N - 1 - x);
+        } else if (insideWorld(x)) {
+            if (y < 0) return cell(-y - 1, x);
+            return cell(2 * N - 1 - y, x);
+        }
+        return 0;
+    }
+    return 0;
+}
+
+void fillHalo(const World& world, const Topology topology, const int width) {
+    // Rule tables keep their states apart from Data
+    const uint8_t* cells = world.States.empty() ? reinterpret_cast<const uint8_t*>(world.Data.cells) : world.States.data();
+
+    halo.width = width;
+    halo.stride = N + 2 * width;
+    halo.outsideRows.resize(static_cast<size_t>(2 * width) * halo.stride);
+    halo.sides.resize(static_cast<size_t>(N) * 2 * width);
+
+    for (int k = 0; k < 2 * width; k++) {
+        const int x = k < width ? k - width : N + k - width;
+        uint8_t* row = halo.outsideRows.data() + static_cast<size_t>(k) * halo.stride;
+        for (int j = 0; j < halo.stride; j++) {
+            row[j] = outsideCell(cells, topology, x, j - width);
+        }
+    }
+
+    for (int x = 0; x < N; x++) {
+        uint8_t* side = halo.sides.data() + static_cast<size_t>(x) * 2 * width;
+        for (int k = 0; k < width; k++) {
+            side[k] = outsideCell(cells, topology, x, k - width);
+            side[width + k] = outsideCell(cells, topology, x, N + k);
+        }
+    }
+}
+
+int haloWidth() {
+    return halo.width;
+}
+
+const uint8_t* outsideRow(const int x) {
+    const int k = x < 0 ? x + halo.width : x - N + halo.width;
+    return halo.outsideRows.data() + static_cast<size_t>(k) * halo.stride;
+}
+
+const uint8_t* paddedStateRow(const World& world, const int x, uint8_t* scratch) {
+    if (!insideWorld(x)) return outsideRow(x);
+
+    const int width = halo.width;
+    const uint8_t* side = halo.sides.data() + static_cast<size_t>(x) * 2 * width;
+    memcpy(scratch, side, width);
+    memcpy(scratch + width, world.States.empty() ? reinterpret_cast<const uint8_t*>(world.Data[x]) : world.stateRow(x), N);
+    memcpy(scratch + width + N, side + width, width);
+    return scratch;
+}
+
+const bool* paddedRow(const World& world, const int x, bool* scratch) {
+    return reinterpret_cast<const bool*>(paddedStateRow(world, x, reinterpret_cast<uint8_t*>(scratch)));
+}
+
+bool haloWest(const int x) {
+    if (!insideWorld(x)) return outsideRow(x)[halo.width - 1];
+    return halo.sides[static_cast<size_t>(x) * 2 * halo.width + halo.width - 1];
+}
+
+bool haloEast(const int x) {
+    if (!insideWorld(x)) return outsideRow(x)[halo.width + N];
+    return halo.sides[static_cast<size_t>(x) * 2 * halo.width + halo.width];
+}
+
+bool* paddedRowScratch(const int count) {
+    thread_local vector<uint8_t> scratch;
+    scratch.resize(static_cast<size_t>(count) * halo.stride);
+    return reinterpret_cast<bool*>(scratch.data());
+}
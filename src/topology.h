@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include "world.h"
+#include "rule.h"
+
+#include <cstdint>
+#include <type_traits>
+
+// Boundary conditions as a halo: before each generation the cells around the
+// world, `width` deep, are filled from the world as its topology joins the
+// edges. Step kernels then read rows padded with the halo and compute every
+// cell the same way, without checking where the world ends.
+void fillHalo(const World& world, Topology topology, int width);
+
+// Depth of the current halo
+int haloWidth();
+
+// Row x of the world, -haloWidth() <= x < N + haloWidth(), padded with the
+// halo on both sides: padded[haloWidth() + y] is column y. Rows inside the
+// world are copied into `scratch` of N + 2 * haloWidth() cells, the others
+// point into the halo. The halo and the state rows come from World::States
+// when the world has them.
+const bool* paddedRow(const World& world, int x, bool* scratch);
+const uint8_t* paddedStateRow(const World& world, int x, uint8_t* scratch);
+
+// Space for `count` padded rows, owned by the calling thread and reused by
+// its next call
+bool* paddedRowScratch(int count);
+
+// Padded rows x - 1, x and x + 1 of a halo one cell deep, of live cells
+// (bool) or states (uint8_t), for kernels walking down their rows one at a
+// time; each step copies one new row.
+template<typename Cell>
+struct PaddedRows {
+    const Cell* above = nullptr;
+    const Cell* row = nullptr;
+    const Cell* below = nullptr;
+
+    void start(const World& world, const int startX) {
+        scratch = paddedRowScratch(3);
+        stride = N + 2 * haloWidth();
+        x = startX;
+        above = load(world, x - 1);
+        row = load(world, x);
+        below = load(world, x + 1);
+    }
+
+    void next(const World& world) {
+        x++;
+        above = row;
+        row = below;
+        below = load(world, x + 1);
+    }
+
+private:
+    bool* scratch = nullptr;
+    int stride = 0;
+    int x = 0;
+
+    // Row r lives in scratch row r mod 3, never that of its neighbours
+    const Cell* load(const World& world, const int rowX) const {
+        bool* rowScratch = scratch + static_cast<size_t>((rowX + 3) % 3) * stride;
+        if constexpr (std::is_same_v<Cell, bool>) {
+            return paddedRow(world, rowX, rowScratch);
+        } else {
+            return paddedStateRow(world, rowX, reinterpret_cast<uint8_t*>(rowScratch));
+        }
+    }
+};
+
+// Cells in columns -1 and N of row x, -1 <= x <= N
+bool haloWest(int x);
+bool haloEast(int x);
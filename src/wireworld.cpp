@@ -0,0 +1,165 @@
+﻿#include "wireworld.h"
+#include "multistate.h"
+
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+constexpr uint8_t EMPTY = 0;
+constexpr uint8_t HEAD = 1;
+constexpr uint8_t TAIL = 2;
+constexpr uint8_t CONDUCTOR = 3;
+
+// Generations of head lists kept; a buffer further behind is copied whole
+constexpr int HEAD_HISTORY = 8;
+
+// Columns of the heads of each row, generation g in slot g % HEAD_HISTORY.
+// The tails of a generation are the heads of the one before.
+vector<vector<int>> headRows[HEAD_HISTORY];
+
+// Generation each row of the three buffers holds, -1 if unknown
+vector<int> rowGenerations[3];
+
+vector<int>& headsOf(const int generation, const int x) {
+    return headRows[(generation % HEAD_HISTORY + HEAD_HISTORY) % HEAD_HISTORY][x];
+}
+
+uint8_t wireworldNext(const uint8_t* cells) {
+    switch (cells[0]) {
+    case HEAD: return TAIL;
+    case TAIL: return CONDUCTOR;
+    case CONDUCTOR: {
+        int heads = 0;
+        for (int i = 1; i < 9; i++) heads += cells[i] == HEAD;
+        return heads == 1 || heads == 2 ? HEAD : CONDUCTOR;
+    }
+    default: return EMPTY;
+    }
+}
+
+bool isWireworld(const RuleTable& table) {
+    if (table.states != 4 || table.shape != NeighbourhoodShape::Moore) return false;
+
+    for (int index = 0; index < 1 << 18; index++) {
+        uint8_t cells[MAX_TABLE_CELLS];
+        for (int cell = 0; cell < 9; cell++) {
+            cells[cell] = static_cast<uint8_t>(index >> 2 * cell & 3);
+        }
+        if (table.next(cells) != wireworldNext(cells)) return false;
+    }
+    return true;
+}
+
+// Neighbour rows and columns wrap around the torus, or end at a plane's edge
+template<bool Wrap>
+bool neighbourAt(int& i) {
+    if (0 <= i && i < N) return true;
+    if constexpr (Wrap) {
+        i = i < 0 ? i + N : i - N;
+        return true;
+    }
+    return false;
+}
+
+template<bool Wrap>
+int headsAround(const World& world, const int x, const int y) {
+    int heads = 0;
+    for (int dx = -1; dx <= 1; dx++) {
+        int nx = x + dx;
+        if (!neighbourAt<Wrap>(nx)) continue;
+        for (int dy = -1; dy <= 1; dy++) {
+            int ny = y + dy;
+            if ((dx != 0 || dy != 0) && neighbourAt<Wrap>(ny)) heads += world.stateRow(nx)[ny] == HEAD;
+        }
+    }
+    return heads;
+}
+
+template<bool Wrap>
+void wireworldStep(const World& worldNow, World& worldNext, const int minX, const int maxX) {
+    const int generation = worldNow.Generation;
+    vector<int>& rowGeneration = rowGenerations[&worldNext - worlds];
+
+    // Conductors of the row already looked at, cleared after each row
+    thread_local vector<uint8_t> visited;
+    thread_local vector<int> visitedColumns;
+    visited.resize(N);
+
+    for (int x = minX; x < maxX; x++) {
+        const uint8_t* now = worldNow.stateRow(x);
+        uint8_t* next = worldNext.stateRow(x);
+
+        // Up to this generation first: a cell changed only around the times
+        // it was a head, so those since the row's generation are enough
+        const int held = rowGeneration[x];
+        if (held >= 0 && generation - held + 2 < HEAD_HISTORY) {
+            for (int g = held - 1; g <= generation; g++) {
+                for (const int y : headsOf(g, x)) next[y] = now[y];
+            }
+        } else {
+            memcpy(next, now, N);
+            memcpy(worldNext.Data[x], worldNow.Data[x], N);
+        }
+
+        for (const int y : headsOf(generation, x)) next[y] = TAIL;
+        for (const int y : headsOf(generation - 1, x)) next[y] = CONDUCTOR;
+
+        vector<int>& newHeads = headsOf(generation + 1, x);
+        newHeads.clear();
+
+        for (int dx = -1; dx <= 1; dx++) {
+            int headX = x + dx;
+            if (!neighbourAt<Wrap>(headX)) continue;
+
+            for (const int headY : headsOf(generation, headX)) {
+                for (int dy = -1; dy <= 1; dy++) {
+                    int y = headY + dy;
+                    if (!neighbourAt<Wrap>(y) || now[y] != CONDUCTOR || visited[y]) continue;
+
+                    visited[y] = 1;
+                    visitedColumns.push_back(y);
+
+                    const int heads = headsAround<Wrap>(worldNow, x, y);
+                    if (heads == 1 || heads == 2) {
+                        next[y] = HEAD;
+                        newHeads.push_back(y);
+                    }
+                }
+            }
+        }
+
+        for (const int y : visitedColumns) visited[y] = 0;
+        visitedColumns.clear();
+
+        rowGeneration[x] = generation + 1;
+    }
+}
+
+StepKernel wireworldKernel(const RuleTable& table, const Topology topology) {
+    if (topology != Topology::Torus && topology != Topology::Plane) return nullptr;
+    if (!isWireworld(table)) return nullptr;
+    return topology == Topology::Torus ? wireworldStep<true> : wireworldStep<false>;
+}
+
+void prepareWireworldWorlds(const int index) {
+    prepareStateWorlds(index);
+
+    const World& world = worlds[index];
+    const int generation = world.Generation;
+
+    for (vector<vector<int>>& rows : headRows) {
+        rows.assign(N, {});
+    }
+    for (int x = 0; x < N; x++) {
+        for (int y = 0; y < N; y++) {
+            const uint8_t state = world.stateRow(x)[y];
+            if (state == HEAD) headsOf(generation, x).push_back(y);
+            if (state == TAIL) headsOf(generation - 1, x).push_back(y);
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        rowGenerations[i].assign(N, i == index ? generation : -1);
+    }
+}
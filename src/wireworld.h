@@ -0,0 +1,17 @@
+﻿#pragma once
+
+#include "sim.h"
+#include "rule_table.h"
+
+// Wireworld (0 empty, 1 electron head, 2 tail, 3 conductor) stepped from
+// lists of the electron heads of recent generations rather than every cell.
+// Only heads, tails and conductors next to heads change, so idle wire costs
+// nothing; a buffer is brought up to date by copying just the cells that
+// were heads since the generation it holds.
+//
+// Returns the sparse step for a table that behaves as Wireworld on the torus
+// or a plane, null otherwise. World::Age upkeep goes through the table kernel.
+StepKernel wireworldKernel(const RuleTable& table, Topology topology);
+
+// prepareStateWorlds, then the head lists of worlds[index]
+void prepareWireworldWorlds(int index);
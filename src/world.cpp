@@ -0,0 +1,100 @@
+﻿#include "world.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+int N = DEFAULT_WORLD_SIZE;
+World worlds[3];
+
+size_t World::storageSize(const int size) {
+    return 2 * static_cast<size_t>(size) * static_cast<size_t>(size);
+}
+
+void World::resize(const int size) {
+    const size_t needed = storageSize(size);
+    if (ownStorage == nullptr || ownCapacity < needed) {
+        ownStorage = make_unique_for_overwrite<uint8_t[]>(needed);
+        ownCapacity = needed;
+    }
+    place(size, ownStorage.get());
+}
+
+void World::place(const int size, uint8_t* storage) {
+    const size_t cellCount = static_cast<size_t>(size) * static_cast<size_t>(size);
+
+    Data = {reinterpret_cast<bool*>(storage), size};
+    Age = {storage + cellCount, size};
+}
+
+void World::copyFrom(const World& other) {
+    if (Data.size != other.Data.size) {
+        resize(other.Data.size);
+    }
+
+    memcpy(Data.cells, other.Data.cells, storageSize(other.Data.size));
+    Planes = other.Planes;
+    PlaneCount = other.PlaneCount;
+    PlaneRowWords = other.PlaneRowWords;
+    States = other.States;
+    Generation = other.Generation;
+    CompletedAt = other.CompletedAt;
+}
+
+void World::clear() {
+    memset(Data.cells, 0, storageSize(Data.size));
+    fill(States.begin(), States.end(), 0);
+    Generation = 0;
+}
+
+void resizeWorlds(const int size) {
+    N = size;
+
+    for (World& world : worlds) {
+        world.resize(size);
+        world.clear();
+
+        // Multi-state engines set their planes up again for the new run
+        world.Planes.clear();
+        world.PlaneCount = 0;
+        world.PlaneRowWords = 0;
+        world.States.clear();
+    }
+}
+
+atomic<int> worldIndicesStore {WorldIndices{}.toInt()};
+
+int moveWorldRenderIndex() {
+    int store = worldIndicesStore.load();
+    WorldIndices currentWorldIndices;
+    WorldIndices newWorldIndices;
+
+    do {
+        currentWorldIndices = WorldIndices{store};
+        newWorldIndices = currentWorldIndices;
+        newWorldIndices.render = currentWorldIndices.simOld;
+    } while (!worldIndicesStore.compare_exchange_strong(store, newWorldIndices.toInt()));
+
+    return currentWorldIndices.render;
+}
+
+void moveWorldSimIndices() {
+    int store = worldIndicesStore.load();
+    WorldIndices currentWorldIndices;
+    WorldIndices newWorldIndices;
+
+    do {
+        currentWorldIndices = WorldIndices{store};
+        newWorldIndices = currentWorldIndices;
+        newWorldIndices.simOld = newWorldIndices.simNext;
+
+        if (newWorldIndices.render != 0 && newWorldIndices.simOld != 0) {
+            newWorldIndices.simNext = 0;
+        } else if (newWorldIndices.render != 1 && newWorldIndices.simOld != 1) {
+            newWorldIndices.simNext = 1;
+        } else {
+            newWorldIndices.simNext = 2;
+        }
+    } while (!worldIndicesStore.compare_exchange_strong(store, newWorldIndices.toInt()));
+}
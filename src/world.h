@@ -0,0 +1,108 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+constexpr int DEFAULT_WORLD_SIZE = 2000;
+
+// Side length of the square world, set through resizeWorlds.
+extern int N;
+
+// Square grid of cells addressed as grid[x][y], like a built-in 2D array.
+template<typename T>
+struct Grid {
+    T* operator[](const int x) { return cells + static_cast<size_t>(x) * size; }
+    const T* operator[](const int x) const { return cells + static_cast<size_t>(x) * size; }
+
+    T* cells = nullptr;
+    int size = 0;
+};
+
+struct World {
+    World() = default;
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+
+    // Bytes of cell storage for a world of `size` x `size`: Data, then Age.
+    static size_t storageSize(int size);
+
+    // Makes the grids `size` x `size`, reusing the current storage when it is
+    // large enough. Cell contents are unspecified afterwards.
+    void resize(int size);
+
+    // Like resize, but on caller-owned memory of storageSize(size) bytes.
+    void place(int size, uint8_t* storage);
+
+    // Copies the cells, ages, planes, states and generation, resizing to match `other`.
+    void copyFrom(const World& other);
+
+    void clear();
+
+    Grid<bool> Data;
+
+    // Generations since each cell last changed state, saturating at 255.
+    // Only maintained while trackCellAge is set.
+    Grid<uint8_t> Age;
+
+    // Bit planes of multi-state rules, PlaneCount planes of size rows of
+    // PlaneRowWords words, packed as in bitpack.h. Set up and maintained by
+    // the engine of such a rule (see generations.h), which keeps Data in step.
+    std::vector<uint64_t> Planes;
+    int PlaneCount = 0;
+    int PlaneRowWords = 0;
+
+    uint64_t* planeRow(const int plane, const int x) {
+        return Planes.data() + (static_cast<size_t>(plane) * Data.size + x) * PlaneRowWords;
+    }
+    const uint64_t* planeRow(const int plane, const int x) const {
+        return Planes.data() + (static_cast<size_t>(plane) * Data.size + x) * PlaneRowWords;
+    }
+
+    // One byte per cell for multi-state rule tables (see rule_table.h), N * N
+    // states row by row, or empty. The engine of such a rule keeps Data in
+    // step as the cells in a non-zero state.
+    std::vector<uint8_t> States;
+
+    uint8_t* stateRow(const int x) { return States.data() + static_cast<size_t>(x) * Data.size; }
+    const uint8_t* stateRow(const int x) const { return States.data() + static_cast<size_t>(x) * Data.size; }
+
+    // Written by the sim before the buffer is published through worldIndicesStore
+    int Generation = 0;
+    std::chrono::steady_clock::time_point CompletedAt;
+
+private:
+    std::unique_ptr<uint8_t[]> ownStorage;
+    size_t ownCapacity = 0;
+};
+extern World worlds[3];
+
+// Sets N and resizes the three buffers to empty worlds of generation 0.
+void resizeWorlds(int size);
+
+struct WorldIndices {
+    WorldIndices() = default;
+
+    explicit WorldIndices(const int store) {
+        constexpr int eightBitMask = 0xFF;
+        render = store & eightBitMask;
+        simOld = (store >> 8) & eightBitMask;
+        simNext = (store >> 16) & eightBitMask;
+    }
+
+    int toInt() const {
+        return render | (simOld << 8) | (simNext << 16);
+    }
+
+    uint8_t render = 0;
+    uint8_t simOld = 0;
+    uint8_t simNext = 1;
+};
+
+extern std::atomic<int> worldIndicesStore;
+
+int moveWorldRenderIndex();
+void moveWorldSimIndices();